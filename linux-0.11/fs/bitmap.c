@@ -28,6 +28,12 @@ __asm__ __volatile__("btrl %2,%3\n\tsetnb %%al": \
 "=a" (res):"0" (0),"r" (nr),"m" (*(addr))); \
 res;})
 
+#define test_bit(nr,addr) ({\
+register int res ; \
+__asm__ __volatile__("btl %2,%3\n\tsetb %%al": \
+"=a" (res):"0" (0),"r" (nr),"m" (*(addr))); \
+res;})
+
 #define find_first_zero(addr) ({ \
 int __res; \
 __asm__ __volatile__ ("cld\n" \
@@ -72,28 +78,11 @@ void free_block(int dev, int block)
 	sb->s_zmap[block/8192]->b_dirt = 1;
 }
 
-int new_block(int dev)
+static void clear_zone(int dev, int block)
 {
 	struct buffer_head * bh;
-	struct super_block * sb;
-	int i,j;
 
-	if (!(sb = get_super(dev)))
-		panic("trying to get new block from nonexistant device");
-	j = 8192;
-	for (i=0 ; i<8 ; i++)
-		if ((bh=sb->s_zmap[i]))
-			if ((j=find_first_zero(bh->b_data))<8192)
-				break;
-	if (i>=8 || !bh || j>=8192)
-		return 0;
-	if (set_bit(j,bh->b_data))
-		panic("new_block: bit already set");
-	bh->b_dirt = 1;
-	j += i*8192 + sb->s_firstdatazone-1;
-	if (j >= sb->s_nzones)
-		return 0;
-	if (!(bh=getblk(dev,j)))
+	if (!(bh=getblk(dev,block)))
 		panic("new_block: cannot get block");
 	if (bh->b_count != 1)
 		panic("new block: count is != 1");
@@ -101,7 +90,208 @@ int new_block(int dev)
 	bh->b_uptodate = 1;
 	bh->b_dirt = 1;
 	brelse(bh);
-	return j;
+}
+
+/*
+ * Files get their zones PREALLOC_ZONES at a time: the first zone a file
+ * needs reserves a run of free zones for it in the zone map, and the next
+ * ones are taken from that run. When the run is used up, the file tries to
+ * reserve the zones right after it. That way files written at the same
+ * time don't end up interleaved zone by zone. What is left of the run is
+ * given back when the last user of the inode iput()s it, or truncates it.
+ *
+ * Bit 'nr' of the zone map is zone nr+s_firstdatazone-1, see free_block().
+ */
+#define PREALLOC_ZONES	16
+
+#define NR_ZMAP_BITS(sb) ((sb)->s_nzones - (sb)->s_firstdatazone + 1)
+
+/* the zone map bit of zone 'goal', or 1 (the first data zone) if none */
+static int goal_bit(struct super_block * sb, int goal)
+{
+	if (goal < sb->s_firstdatazone || goal >= sb->s_nzones)
+		return 1;
+	return goal - sb->s_firstdatazone + 1;
+}
+
+/* the number of free zones (at most 'max') starting at bit 'nr' */
+static int free_run(struct super_block * sb, int nr, int max)
+{
+	struct buffer_head * bh;
+	int n;
+
+	for (n = 0 ; n < max && nr+n < NR_ZMAP_BITS(sb) ; n++)
+		if (!(bh = sb->s_zmap[(nr+n)>>13]) ||
+		    test_bit((nr+n)&8191,bh->b_data))
+			break;
+	return n;
+}
+
+/*
+ * find_run_between() returns the bit of the first run of 'want' free
+ * zones starting in [nr,end), or of the first free zone there if there is
+ * no run that long. The length is returned in *len. Returns 0 if there is
+ * no free zone.
+ */
+static int find_run_between(struct super_block * sb, int nr, int end,
+	int want, int * len)
+{
+	struct buffer_head * bh;
+	int n, first = 0;
+
+	for ( ; nr < end ; nr++) {
+		if (!(bh = sb->s_zmap[nr>>13]))
+			break;
+		if (!(nr&7) && ((unsigned char *) bh->b_data)[(nr&8191)>>3] == 0xff) {
+			nr += 7;
+			continue;
+		}
+		if (!(n = free_run(sb,nr,want)))
+			continue;
+		if (!first) {
+			first = nr;
+			*len = n;
+		}
+		if (n == want) {
+			*len = n;
+			return nr;
+		}
+		nr += n;
+	}
+	return first;
+}
+
+/*
+ * find_free_run() is find_run_between() for the whole map, looking
+ * forward from bit 'goal' first: files are read forward, so a run after
+ * the goal is the better one. Only then does it wrap around to the start.
+ */
+static int find_free_run(struct super_block * sb, int goal, int want, int * len)
+{
+	int nr, n, first_len = 0;
+
+	if ((nr = find_run_between(sb,goal,NR_ZMAP_BITS(sb),want,len))) {
+		if (*len == want)
+			return nr;
+		first_len = *len;
+	}
+	if ((n = find_run_between(sb,1,goal,want,len)) && (*len == want || !nr))
+		return n;
+	*len = first_len;
+	return nr;
+}
+
+/* a free bit in the byte of the zone map holding bit 'nr', or 0 */
+static int free_in_byte(struct super_block * sb, int nr)
+{
+	struct buffer_head * bh;
+	int i;
+
+	nr &= ~7;
+	if (!(bh = sb->s_zmap[nr>>13]) ||
+	    ((unsigned char *) bh->b_data)[(nr&8191)>>3] == 0xff)
+		return 0;
+	for (i = nr ; i < nr+8 && i < NR_ZMAP_BITS(sb) ; i++)
+		if (i && !test_bit(i&8191,bh->b_data))
+			return i;
+	return 0;
+}
+
+/*
+ * find_free_near() returns the free bit nearest to 'goal', looking a byte
+ * of the map at a time in both directions. Returns 0 if the device is
+ * full.
+ */
+static int find_free_near(struct super_block * sb, int goal)
+{
+	int lo, hi, nr;
+
+	if (free_run(sb,goal,1))
+		return goal;
+	for (lo = hi = goal & ~7 ; lo >= 0 || hi < NR_ZMAP_BITS(sb) ;
+	    lo -= 8, hi += 8) {
+		if (hi < NR_ZMAP_BITS(sb) && (nr = free_in_byte(sb,hi)))
+			return nr;
+		if (lo >= 0 && lo != hi && (nr = free_in_byte(sb,lo)))
+			return nr;
+	}
+	return 0;
+}
+
+/*
+ * new_block() takes the free zone nearest to zone 'goal' - say, one the
+ * new block will be read together with. With no goal (0) that is the
+ * first free one, the one nearest to the inode table.
+ */
+int new_block(int dev, int goal)
+{
+	struct buffer_head * bh;
+	struct super_block * sb;
+	int nr;
+
+	if (!(sb = get_super(dev)))
+		panic("trying to get new block from nonexistant device");
+	if (!(nr = find_free_near(sb,goal_bit(sb,goal))))
+		return 0;
+	bh = sb->s_zmap[nr>>13];
+	if (set_bit(nr&8191,bh->b_data))
+		panic("new_block: bit already set");
+	bh->b_dirt = 1;
+	nr += sb->s_firstdatazone-1;
+	clear_zone(dev,nr);
+	return nr;
+}
+
+/*
+ * new_file_block() is new_block() for a zone of the given inode, taken
+ * from the inode's preallocated run. 'goal' is the zone of the block
+ * before it in the file, if the caller knows it: a new run starts right
+ * after that, or else right after the last run, or else as near as it
+ * can after it. A file without zones yet starts near the inode table.
+ */
+int new_file_block(struct m_inode * inode, int goal)
+{
+	struct super_block * sb;
+	struct buffer_head * bh;
+	int nr, len, i;
+
+	if (!(sb = get_super(inode->i_dev)))
+		panic("trying to get new block from nonexistant device");
+	if (!inode->i_prealloc_count) {
+		if (goal >= sb->s_firstdatazone)
+			goal++;
+		else
+			goal = inode->i_prealloc_block;
+		len = 0;
+		nr = goal_bit(sb,goal);
+		if (goal >= sb->s_firstdatazone && goal < sb->s_nzones)
+			len = free_run(sb,nr,PREALLOC_ZONES);
+		if (!len && !(nr = find_free_run(sb,nr,PREALLOC_ZONES,&len)))
+			return 0;
+		for (i = 0 ; i < len ; i++) {
+			bh = sb->s_zmap[(nr+i)>>13];
+			if (set_bit((nr+i)&8191,bh->b_data))
+				panic("new_file_block: bit already set");
+			bh->b_dirt = 1;
+		}
+		inode->i_prealloc_block = nr + sb->s_firstdatazone - 1;
+		inode->i_prealloc_count = len;
+	}
+	nr = inode->i_prealloc_block++;
+	inode->i_prealloc_count--;
+	clear_zone(inode->i_dev,nr);
+	return nr;
+}
+
+void discard_prealloc(struct m_inode * inode)
+{
+	int block, count;
+
+	block = inode->i_prealloc_block;
+	count = inode->i_prealloc_count;
+	inode->i_prealloc_count = 0;
+	while (count-- > 0)
+		free_block(inode->i_dev,block++);
 }
 
 void free_inode(struct m_inode * inode)
@@ -112,7 +302,7 @@ void free_inode(struct m_inode * inode)
 	if (!inode)
 		return;
 	if (!inode->i_dev) {
-		memset(inode,0,sizeof(*inode));
+		clear_inode(inode);
 		return;
 	}
 	if (inode->i_count>1) {
@@ -130,7 +320,7 @@ void free_inode(struct m_inode * inode)
 	if (clear_bit(inode->i_num&8191,bh->b_data))
 		printk("free_inode: bit already cleared.\n\r");
 	bh->b_dirt = 1;
-	memset(inode,0,sizeof(*inode));
+	clear_inode(inode);
 }
 
 struct m_inode * new_inode(int dev)
@@ -163,6 +353,7 @@ struct m_inode * new_inode(int dev)
 	inode->i_gid=current->egid;
 	inode->i_dirt=1;
 	inode->i_num = j + i*8192;
+	insert_inode_hash(inode);
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
 	return inode;
 }
@@ -19,23 +19,93 @@
  */
 
 #include <stdarg.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/bufstat.h>
  
 #include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
 #include <asm/system.h>
+#include <asm/segment.h>
 #include <asm/io.h>
 
 extern int end;
 extern void put_super(int);
 extern void invalidate_inodes(int);
+extern struct task_struct * wait_for_request;
 
 struct buffer_head * start_buffer = (struct buffer_head *) &end;
-struct buffer_head * hash_table[NR_HASH];
-static struct buffer_head * free_list;
+struct buffer_head ** hash_table;
+int nr_hash = 0;		/* always a power of two */
+static int hash_shift = 32;	/* 32 - log2(nr_hash) */
+static struct buffer_head * lru_list[NR_LIST] = {NULL,};
+static int nr_buffers_type[NR_LIST] = {0,};
 static struct task_struct * buffer_wait = NULL;
 int NR_BUFFERS = 0;
 
+/* getblk() misses, and the number of lru-list nodes they looked at */
+static unsigned long nr_getblk_miss = 0;
+static unsigned long nr_getblk_visit = 0;
+/* times getblk() had to write out a dirty victim, and ticks spent on it */
+static unsigned long nr_getblk_dirty = 0;
+static unsigned long getblk_dirty_ticks = 0;
+
+/*
+ * Tuning for the bdflush daemon, see sys_bdflush():
+ *	0 - interval: ticks between two wakeups of the daemon
+ *	1 - age: ticks a released dirty buffer may wait for writeback
+ *	2 - ratio: percentage of dirty buffers that wakes the daemon early
+ *	3 - ndirty: max buffers written per pass when over the ratio
+ */
+#define NR_BDF_PARAM 4
+static long bdf_prm[NR_BDF_PARAM] = {5*HZ, 30*HZ, 40, 64};
+static long bdf_min[NR_BDF_PARAM] = {HZ/10, 0, 1, 1};
+static long bdf_max[NR_BDF_PARAM] = {600*HZ, 600*HZ, 100, 1000};
+
+/* per-device statistics, see sys_bufstat() */
+static struct buffer_stat bstat[NR_BUFSTAT];
+static struct buffer_stat bstat_overflow;
+
+static struct task_struct * bdflush_wait = NULL;
+static struct task_struct * bdflush_task = NULL;
+static int bdflush_timer_pending = 0;
+
+/*
+ * The cache grows past what buffer_init() set up by taking pages from
+ * get_free_page() when it misses a lot and memory is plentiful, and gives
+ * them back in shrink_buffers() when memory runs out. A grown page holds
+ * 4 buffers. Their heads come from pages of their own, in groups of 4,
+ * so the buffers of one page are always next to each other. The heads of
+ * a page that was given back have b_data == NULL, and get used again.
+ */
+#define HEADS_PER_PAGE	((PAGE_SIZE/sizeof(struct buffer_head)) & ~3)
+#define MAX_HEAD_PAGES	80
+#define GROW_MIN_FREE	256	/* free pages always left to everybody else */
+#define GROW_MISS_RATIO	10	/* percentage of misses that makes us grow */
+
+static struct buffer_head * head_pages[MAX_HEAD_PAGES] = {NULL,};
+static int nr_static_buffers = 0;
+static int nr_buffer_heads = 0;		/* static + grown, in use or not */
+static int nr_grown_pages = 0;
+static int nr_unused_groups = 0;	/* groups of 4 heads without a page */
+/* recent getblk() lookups and misses, both halved every 256 lookups */
+static int recent_lookups = 0;
+static int recent_misses = 0;
+
+/*
+ * nth_buffer() is how to walk all the buffer heads: the first ones are
+ * the array buffer_init() made, the rest are in head_pages.
+ */
+static inline struct buffer_head * nth_buffer(int i)
+{
+	if (i < nr_static_buffers)
+		return start_buffer + i;
+	i -= nr_static_buffers;
+	return head_pages[i / HEADS_PER_PAGE] + i % HEADS_PER_PAGE;
+}
+
 /*
 struct buffer_head {
 	char * b_data;			// 指向该缓冲块中数据区(1024字节)的指针
@@ -45,14 +115,38 @@ struct buffer_head {
 	unsigned char b_dirt;		// 修改标志，脏位
 	unsigned char b_count;		// 使用该块的用户数
 	unsigned char b_lock;		// 是否被锁
+	unsigned char b_list;		// 所在的 lru 链表：BUF_CLEAN/BUF_LOCKED/BUF_DIRTY
+	unsigned char b_reada;		// 预读进来的块，还没有被用过
+	unsigned long b_flushtime;	// 脏块应该被 bdflush 写回的时间（滴答）
 	struct task_struct * b_wait;   // 指向等待该缓冲区解锁的任务（进程）
 	struct buffer_head * b_prev;   // hash 队列上前一块
 	struct buffer_head * b_next;   // hash 队列上下一块
-	struct buffer_head * b_prev_free;  // 空闲表上前一块
-	struct buffer_head * b_next_free;  // 空闲表上下一块
+	struct buffer_head * b_prev_free;  // lru 表上前一块
+	struct buffer_head * b_next_free;  // lru 表上下一块
 };
 
  */
+/*
+ * get_bstat() returns the statistics slot of a device, taking a new one
+ * on first use. Slots are only ever taken in order, so the first free
+ * one means the device isn't there. Devices beyond NR_BUFSTAT all go
+ * to a slot nobody reports.
+ */
+static struct buffer_stat * get_bstat(int dev)
+{
+	struct buffer_stat * bs;
+
+	for (bs = bstat ; bs < bstat + NR_BUFSTAT ; bs++) {
+		if (bs->bs_dev == dev)
+			return bs;
+		if (!bs->bs_dev) {
+			bs->bs_dev = dev;
+			return bs;
+		}
+	}
+	return &bstat_overflow;
+}
+
 static inline void wait_on_buffer(struct buffer_head * bh)
 {
 	/* 如果该缓冲区加了锁，就主动让出 cpu，并加入等待队列。 */
@@ -62,6 +156,73 @@ static inline void wait_on_buffer(struct buffer_head * bh)
 	sti();
 }
 
+#define SYNC_BATCH ((int) (PAGE_SIZE/sizeof(struct buffer_head *)))
+
+static inline int blk_before(struct buffer_head * a, struct buffer_head * b)
+{
+	return a->b_dev < b->b_dev ||
+		(a->b_dev == b->b_dev && a->b_blocknr < b->b_blocknr);
+}
+
+/* a plain shell sort on (b_dev,b_blocknr): n is at most SYNC_BATCH */
+static void sort_buffers(struct buffer_head ** v, int n)
+{
+	struct buffer_head * tmp;
+	int gap, i, j;
+
+	for (gap = n/2 ; gap > 0 ; gap /= 2)
+		for (i = gap ; i < n ; i++)
+			for (j = i-gap ; j >= 0 && blk_before(v[j+gap],v[j]) ; j -= gap) {
+				tmp = v[j];
+				v[j] = v[j+gap];
+				v[j+gap] = tmp;
+			}
+}
+
+/*
+ * write_dirty_buffers() writes out the dirty buffers of 'dev' (of all
+ * devices if dev is 0) sorted by device and block number. Walking the
+ * buffers in memory order gives the elevator an effectively random
+ * request stream, and it only ever sees NR_REQUEST of them at a time
+ * (writes only 2/3 of that), so we hand it ascending runs instead.
+ * The buffers are gathered a page of pointers at a time; with more
+ * dirty buffers than fit, every batch is still one ascending sweep.
+ */
+static void write_dirty_buffers(int dev)
+{
+	struct buffer_head ** list, * bh;
+	int i, n, start;
+
+	if (!(list = (struct buffer_head **) get_free_page())) {
+		for (i=0 ; i<nr_buffer_heads ; i++) {
+			bh = nth_buffer(i);
+			if (dev && bh->b_dev != dev)
+				continue;
+			wait_on_buffer(bh);
+			if ((!dev || bh->b_dev == dev) && bh->b_dirt)
+				ll_rw_block(WRITE,bh);
+		}
+		return;
+	}
+	start = 0;
+	while (start < nr_buffer_heads) {
+		for (n=0 ; start<nr_buffer_heads && n<SYNC_BATCH ; start++)
+			if ((bh = nth_buffer(start))->b_dirt && (!dev || bh->b_dev == dev))
+				list[n++] = bh;
+		sort_buffers(list,n);
+		for (i=0 ; i<n ; i++) {
+			bh = list[i];
+			wait_on_buffer(bh);
+			/* 睡眠期间，该缓冲块有可能已被写出、释放或者被挪作它用 */
+			if (bh->b_dirt && (!dev || bh->b_dev == dev)) {
+				get_bstat(bh->b_dev)->bs_sync_writes++;
+				ll_rw_block(WRITE,bh);
+			}
+		}
+	}
+	free_page((unsigned long) list);
+}
+
 /*
 	设备数据同步。同步设备和内存高速缓冲中的数据。其中，sync_inodes() 定义在 inode.c 中
 
@@ -71,16 +232,8 @@ static inline void wait_on_buffer(struct buffer_head * bh)
  */
 int sys_sync(void)
 {
-	int i;
-	struct buffer_head * bh;
-
 	sync_inodes();		/* 把 i 节点写入缓冲区 */
-	bh = start_buffer; /* bh 指向缓冲区开始处，上图 end 那个地方 */
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		wait_on_buffer(bh);
-		if (bh->b_dirt)
-			ll_rw_block(WRITE,bh); /* 产生写设备块请求 */
-	}
+	write_dirty_buffers(0); /* 按设备号、块号排序后产生写设备块请求 */
 	return 0;
 }
 
@@ -92,29 +245,12 @@ int sys_sync(void)
  */
 int sync_dev(int dev)
 {
-	int i;
-	struct buffer_head * bh;
-
 	/* 对指定的设备号产生写请求 */
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_dirt) /* 睡眠期间，该缓冲块有可能已被释放或者被挪作它用 */
-			ll_rw_block(WRITE,bh);
-	}
+	write_dirty_buffers(dev);
 
 	/* 同步 inodes 节点，将 i 节点写入高速缓冲。*/
 	sync_inodes();
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_dirt)
-			ll_rw_block(WRITE,bh);
-	}
+	write_dirty_buffers(dev);
 	return 0;
 }
 
@@ -123,8 +259,8 @@ void inline invalidate_buffers(int dev)
 	int i;
 	struct buffer_head * bh;
 
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
+	for (i=0 ; i<nr_buffer_heads ; i++) {
+		bh = nth_buffer(i);
 		if (bh->b_dev != dev)
 			continue;
 		wait_on_buffer(bh);
@@ -160,44 +296,126 @@ void check_disk_change(int dev)
 			put_super(super_block[i].s_dev);
 	invalidate_inodes(dev);
 	invalidate_buffers(dev);
+	invalidate_cache_dev(dev);
+	dcache_invalidate_dev(dev);
 }
 
-#define _hashfn(dev,block) (((unsigned)(dev^block))%NR_HASH)
+/*
+ * Multiplicative hashing: the top bits of the product depend on all the
+ * bits of the key, so neither consecutive blocks nor the same block on
+ * different devices end up on the same few chains, as they did with
+ * (dev^block)%NR_HASH.
+ */
+#define _hashfn(dev,block) \
+((((unsigned)(block) ^ ((unsigned)(dev)<<16)) * 2654435761U) >> hash_shift)
 #define hash(dev,block) hash_table[_hashfn(dev,block)]
 
-static inline void remove_from_queues(struct buffer_head * bh)
+/*
+ * The lru-lists replace the single free_list. The b_dirt and b_lock
+ * flags are changed all over the place (and b_lock from interrupts), so
+ * the lists are not kept exact: a buffer is refiled when it is released,
+ * and getblk() refiles whatever it finds on the wrong list. That keeps
+ * the interrupt routines out of the list handling altogether.
+ */
+static inline int buffer_list(struct buffer_head * bh)
+{
+	if (bh->b_dirt)
+		return BUF_DIRTY;
+	if (bh->b_lock)
+		return BUF_LOCKED;
+	return BUF_CLEAN;
+}
+
+static inline void remove_from_lru_list(struct buffer_head * bh)
+{
+	if (!(bh->b_prev_free) || !(bh->b_next_free))
+		panic("Free block list corrupted");
+	if (bh->b_next_free == bh)
+		lru_list[bh->b_list] = NULL;
+	else {
+		bh->b_prev_free->b_next_free = bh->b_next_free;
+		bh->b_next_free->b_prev_free = bh->b_prev_free;
+		if (lru_list[bh->b_list] == bh)
+			lru_list[bh->b_list] = bh->b_next_free;
+	}
+	bh->b_next_free = bh->b_prev_free = NULL;
+	nr_buffers_type[bh->b_list]--;
+}
+
+static inline void put_last_lru(struct buffer_head * bh, int list)
+{
+	struct buffer_head * head = lru_list[list];
+
+	bh->b_list = list;
+	nr_buffers_type[list]++;
+	if (!head) {
+		lru_list[list] = bh->b_next_free = bh->b_prev_free = bh;
+		return;
+	}
+	bh->b_next_free = head;
+	bh->b_prev_free = head->b_prev_free;
+	head->b_prev_free->b_next_free = bh;
+	head->b_prev_free = bh;
+}
+
+static inline int too_many_dirty(void)
+{
+	return nr_buffers_type[BUF_DIRTY]*100 > bdf_prm[2]*NR_BUFFERS;
+}
+
+/*
+ * refile_buffer() moves a buffer to the end of the list its flags say
+ * it belongs on. It's also how a released buffer becomes most recently
+ * used. A buffer that just turned dirty gets its flush time here, and
+ * wakes up bdflush if there are too many of them.
+ */
+void refile_buffer(struct buffer_head * bh)
+{
+	int list = buffer_list(bh);
+
+	if (list == BUF_DIRTY && bh->b_list != BUF_DIRTY) {
+		bh->b_flushtime = jiffies + bdf_prm[1];
+		if (too_many_dirty())
+			wake_up(&bdflush_wait);
+	}
+	remove_from_lru_list(bh);
+	put_last_lru(bh,list);
+}
+
+static inline void remove_from_hash(struct buffer_head * bh)
 {
-/* remove from hash-queue */
 	if (bh->b_next)
 		bh->b_next->b_prev = bh->b_prev;
 	if (bh->b_prev)
 		bh->b_prev->b_next = bh->b_next;
 	if (hash(bh->b_dev,bh->b_blocknr) == bh)
 		hash(bh->b_dev,bh->b_blocknr) = bh->b_next;
-/* remove from free list */
-	if (!(bh->b_prev_free) || !(bh->b_next_free))
-		panic("Free block list corrupted");
-	bh->b_prev_free->b_next_free = bh->b_next_free;
-	bh->b_next_free->b_prev_free = bh->b_prev_free;
-	if (free_list == bh)
-		free_list = bh->b_next_free;
 }
 
-static inline void insert_into_queues(struct buffer_head * bh)
-{
-/* put at end of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
 /* put the buffer in new hash-queue if it has a device */
+static inline void insert_into_hash(struct buffer_head * bh)
+{
 	bh->b_prev = NULL;
 	bh->b_next = NULL;
 	if (!bh->b_dev)
 		return;
 	bh->b_next = hash(bh->b_dev,bh->b_blocknr);
 	hash(bh->b_dev,bh->b_blocknr) = bh;
-	bh->b_next->b_prev = bh;
+	if (bh->b_next)
+		bh->b_next->b_prev = bh;
+}
+
+static inline void remove_from_queues(struct buffer_head * bh)
+{
+	remove_from_hash(bh);
+	remove_from_lru_list(bh);
+}
+
+static inline void insert_into_queues(struct buffer_head * bh)
+{
+/* put at end of the clean list: getblk only hands out clean buffers */
+	put_last_lru(bh,BUF_CLEAN);
+	insert_into_hash(bh);
 }
 
 static struct buffer_head * find_buffer(int dev, int block)
@@ -232,43 +450,242 @@ struct buffer_head * get_hash_table(int dev, int block)
 	}
 }
 
+/*
+ * find_victim() returns the least recently used free buffer, looking at
+ * the clean list first, then the locked and last the dirty one. Buffers
+ * found on the wrong list are refiled as we go, so normally the head of
+ * the clean list is the answer and the other lists are never touched.
+ */
+static struct buffer_head * find_victim(void)
+{
+	struct buffer_head * bh, * next;
+	int list, i, real;
+
+	nr_getblk_miss++;
+	for (list = BUF_CLEAN ; list < NR_LIST ; list++) {
+		bh = lru_list[list];
+		for (i = nr_buffers_type[list] ; i-- > 0 ; bh = next) {
+			next = bh->b_next_free;
+			nr_getblk_visit++;
+			if (bh->b_count)
+				continue;
+			if ((real = buffer_list(bh)) != list) {
+				refile_buffer(bh);
+				if (real > list)
+					continue;
+			}
+			return bh;
+		}
+	}
+	return NULL;
+}
+
+static inline void put_first_lru(struct buffer_head * bh, int list)
+{
+	put_last_lru(bh,list);
+	lru_list[list] = bh;
+}
+
+static inline int want_more_buffers(void)
+{
+	return recent_lookups >= 64 &&
+		recent_misses*100 > GROW_MISS_RATIO*recent_lookups &&
+		nr_free_pages > GROW_MIN_FREE;
+}
+
+/*
+ * grow_buffers() adds a page worth of free buffers to the cache. They go
+ * first on the clean list, so getblk() uses them before it evicts any
+ * cached block. Returns 1 if it got the memory.
+ */
+static int grow_buffers(void)
+{
+	struct buffer_head * bh;
+	unsigned long page;
+	int i, j;
+
+	i = nr_buffer_heads;
+	if (nr_unused_groups) {
+		for (i = nr_static_buffers ; i < nr_buffer_heads ; i += 4)
+			if (!nth_buffer(i)->b_data)
+				break;
+	} else {
+		j = (i - nr_static_buffers) / HEADS_PER_PAGE;
+		if (j >= MAX_HEAD_PAGES)
+			return 0;
+		if (!head_pages[j] && !(head_pages[j] =
+		    (struct buffer_head *) get_free_page()))
+			return 0;
+	}
+	if (!(page = get_free_page()))
+		return 0;
+	if (i < nr_buffer_heads)
+		nr_unused_groups--;
+	else
+		nr_buffer_heads += 4;
+	for (j=0 ; j<4 ; j++) {
+		bh = nth_buffer(i+j);
+		bh->b_dev = 0;
+		bh->b_dirt = 0;
+		bh->b_count = 0;
+		bh->b_lock = 0;
+		bh->b_uptodate = 0;
+		bh->b_reada = 0;
+		bh->b_wait = NULL;
+		bh->b_next = NULL;
+		bh->b_prev = NULL;
+		bh->b_reqnext = NULL;
+		bh->b_data = (char *) (page + j*BLOCK_SIZE);
+		put_first_lru(bh,BUF_CLEAN);
+	}
+	NR_BUFFERS += 4;
+	nr_grown_pages++;
+	return 1;
+}
+
+/*
+ * shrink_buffers() gives a grown page back to the free pool, if all its
+ * buffers are unused and clean. get_free_page() calls it when it runs
+ * out of memory. Returns 1 if it freed a page.
+ */
+int shrink_buffers(void)
+{
+	struct buffer_head * bh;
+	unsigned long page;
+	int i, j;
+
+	for (i = nr_static_buffers ; i < nr_buffer_heads ; i += 4) {
+		bh = nth_buffer(i);
+		if (!bh->b_data)
+			continue;
+		for (j=0 ; j<4 ; j++)
+			if (bh[j].b_count || bh[j].b_dirt || bh[j].b_lock)
+				break;
+		if (j < 4)
+			continue;
+		page = (unsigned long) bh->b_data;
+		for (j=0 ; j<4 ; j++) {
+			remove_from_queues(bh+j);
+			bh[j].b_dev = 0;
+			bh[j].b_uptodate = 0;
+			bh[j].b_data = NULL;
+		}
+		free_page(page);
+		NR_BUFFERS -= 4;
+		nr_grown_pages--;
+		nr_unused_groups++;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Blocks of the ramdisk aren't copied into the cache: their buffers point
+ * right into the ramdisk, so they are always up to date and writing them
+ * out is nothing to do. The heads come from a pool of their own, and are
+ * in the hash table but on no lru list - nothing evicts them, sync never
+ * sees them, and their memory can't be given to another block.
+ */
+#define NR_RD_BUFFERS	64
+#define RD_DEV		0x0101
+
+extern char * rd_start;
+extern int rd_length;
+
+static struct buffer_head rd_buffers[NR_RD_BUFFERS];
+static struct buffer_head * rd_hand = rd_buffers;
+
+#define rd_buffer(bh) ((bh) >= rd_buffers && (bh) < rd_buffers+NR_RD_BUFFERS)
+
+static struct buffer_head * get_rd_buffer(int block)
+{
+	struct buffer_head * bh;
+	int i;
+
+repeat:
+	if ((bh = get_hash_table(RD_DEV,block)))
+		return bh;
+	for (i = NR_RD_BUFFERS ; i-- > 0 ; ) {
+		bh = rd_hand;
+		if (++rd_hand >= rd_buffers + NR_RD_BUFFERS)
+			rd_hand = rd_buffers;
+		if (!bh->b_count && !bh->b_lock)
+			break;
+	}
+	if (bh->b_count || bh->b_lock) {
+		sleep_on(&buffer_wait);
+		goto repeat;
+	}
+	remove_from_hash(bh);
+	bh->b_dev = RD_DEV;
+	bh->b_blocknr = block;
+	bh->b_data = rd_start + (block << BLOCK_SIZE_BITS);
+	bh->b_count = 1;
+	bh->b_uptodate = 1;
+	bh->b_dirt = 0;
+	bh->b_reada = 0;
+	insert_into_hash(bh);
+	return bh;
+}
+
 /*
  * Ok, this is getblk, and it isn't very clear, again to hinder
  * race-conditions. Most of the code is seldom used, (ie repeating),
  * so it should be much more efficient than it looks.
  *
  * The algoritm is changed: hopefully better, and an elusive bug removed.
+ * Writeback is only started when no clean or locked buffer is free.
+ *
+ * get_buffer() is getblk() that does the statistics in 'bs' - or none,
+ * if bs is NULL, which is what the read-ahead code uses.
  */
-#define BADNESS(bh) (((bh)->b_dirt<<1)+(bh)->b_lock)
-struct buffer_head * getblk(int dev,int block)
+static struct buffer_head * get_buffer(int dev,int block,
+	struct buffer_stat * bs)
 {
-	struct buffer_head * tmp, * bh;
+	struct buffer_head * bh;
 
+	if (bs) {
+		bs->bs_lookups++;
+		if (++recent_lookups >= 256) {
+			recent_lookups >>= 1;
+			recent_misses >>= 1;
+		}
+	}
+	if (dev == RD_DEV && block < (rd_length >> BLOCK_SIZE_BITS)) {
+		if (bs)
+			bs->bs_hits++;
+		return get_rd_buffer(block);
+	}
 repeat:
-	if ((bh = get_hash_table(dev,block)))
-		return bh;
-	tmp = free_list;
-	do {
-		if (tmp->b_count)
-			continue;
-		if (!bh || BADNESS(tmp)<BADNESS(bh)) {
-			bh = tmp;
-			if (!BADNESS(tmp))
-				break;
+	if ((bh = get_hash_table(dev,block))) {
+		if (bs) {
+			bs->bs_hits++;
+			if (bh->b_reada && bh->b_uptodate)
+				bs->bs_rahits++;
+			bh->b_reada = 0;
 		}
-/* and repeat until we find something good */
-	} while ((tmp = tmp->b_next_free) != free_list);
-	if (!bh) {
+		return bh;
+	}
+	if (bs && want_more_buffers())
+		grow_buffers();
+	if (!(bh = find_victim())) {
 		sleep_on(&buffer_wait);
 		goto repeat;
 	}
+/* a grown buffer can be given back to get_free_page() while we sleep */
 	wait_on_buffer(bh);
-	if (bh->b_count)
+	if (bh->b_count || !bh->b_data)
 		goto repeat;
 	while (bh->b_dirt) {
+		long start = jiffies;
+
+		nr_getblk_dirty++;
+		get_bstat(bh->b_dev)->bs_dirty_evict++;
+		wake_up(&bdflush_wait);
 		sync_dev(bh->b_dev);
 		wait_on_buffer(bh);
-		if (bh->b_count)
+		getblk_dirty_ticks += jiffies - start;
+		if (bh->b_count || !bh->b_data)
 			goto repeat;
 	}
 /* NOTE!! While we slept waiting for this block, somebody else might */
@@ -280,13 +697,23 @@ repeat:
 	bh->b_count=1;
 	bh->b_dirt=0;
 	bh->b_uptodate=0;
+	bh->b_reada=0;
 	remove_from_queues(bh);
 	bh->b_dev=dev;
 	bh->b_blocknr=block;
 	insert_into_queues(bh);
+	if (bs) {
+		bs->bs_misses++;
+		recent_misses++;
+	}
 	return bh;
 }
 
+struct buffer_head * getblk(int dev,int block)
+{
+	return get_buffer(dev,block,get_bstat(dev));
+}
+
 void brelse(struct buffer_head * buf)
 {
 	if (!buf)
@@ -294,6 +721,10 @@ void brelse(struct buffer_head * buf)
 	wait_on_buffer(buf);
 	if (!(buf->b_count--))
 		panic("Trying to free free buffer");
+	if (rd_buffer(buf))
+		buf->b_dirt = 0;
+	else if (!buf->b_count)
+		refile_buffer(buf);
 	wake_up(&buffer_wait);
 }
 
@@ -328,12 +759,13 @@ __asm__("cld\n\t" \
  * bread_page reads four buffers into memory at the desired address. It's
  * a function of its own, as there is some speed to be got by reading them
  * all at the same time, not waiting for one to be read, and then another
- * etc.
+ * etc. Returns 0 if a block couldn't be read (its part of the page is
+ * left as it was).
  */
-void bread_page(unsigned long address,int dev,int b[4])
+int bread_page(unsigned long address,int dev,int b[4])
 {
 	struct buffer_head * bh[4];
-	int i;
+	int i, ok = 1;
 
 	for (i=0 ; i<4 ; i++)
 		if (b[i]) {
@@ -347,8 +779,11 @@ void bread_page(unsigned long address,int dev,int b[4])
 			wait_on_buffer(bh[i]);
 			if (bh[i]->b_uptodate)
 				COPYBLK((unsigned long) bh[i]->b_data,address);
+			else
+				ok = 0;
 			brelse(bh[i]);
 		}
+	return ok;
 }
 
 /*
@@ -367,10 +802,12 @@ struct buffer_head * breada(int dev,int first, ...)
 	if (!bh->b_uptodate)
 		ll_rw_block(READ,bh);
 	while ((first=va_arg(args,int))>=0) {
-		tmp=getblk(dev,first);
+		tmp=get_buffer(dev,first,NULL);
 		if (tmp) {
-			if (!tmp->b_uptodate)
-				ll_rw_block(READA,bh);
+			if (!tmp->b_uptodate) {
+				tmp->b_reada = 1;
+				ll_rw_block(READA,tmp);
+			}
 			tmp->b_count--;
 		}
 	}
@@ -382,6 +819,23 @@ struct buffer_head * breada(int dev,int first, ...)
 	return (NULL);
 }
 
+/*
+ * read_ahead() starts reading a block without waiting for it, like
+ * breada() does with the blocks after the first one.
+ */
+void read_ahead(int dev,int block)
+{
+	struct buffer_head * bh;
+
+	if (!(bh=get_buffer(dev,block,NULL)))
+		panic("read_ahead: getblk returned NULL\n");
+	if (!bh->b_uptodate) {
+		bh->b_reada = 1;
+		ll_rw_block(READA,bh);
+	}
+	bh->b_count--;
+}
+
 void buffer_init(long buffer_end)
 {
 	struct buffer_head * h = start_buffer;
@@ -392,15 +846,31 @@ void buffer_init(long buffer_end)
 		b = (void *) (640*1024);
 	else
 		b = (void *) buffer_end;
+/*
+ * The hash table goes at the top of the buffer memory, sized to have
+ * about one chain per buffer. nr_hash is at least 256, so the table is
+ * a whole number of blocks and the buffers stay block aligned.
+ */
+	i = b - (void *) start_buffer;
+	if (buffer_end > 1<<20)
+		i -= 0x100000 - 0xA0000;
+	i /= BLOCK_SIZE + sizeof(struct buffer_head);
+	for (nr_hash = 256, hash_shift = 24 ; nr_hash < i ; nr_hash <<= 1)
+		hash_shift--;
+	b -= nr_hash * sizeof(struct buffer_head *);
+	hash_table = (struct buffer_head **) b;
 	while ( (b -= BLOCK_SIZE) >= ((void *) (h+1)) ) {
 		h->b_dev = 0;
 		h->b_dirt = 0;
 		h->b_count = 0;
 		h->b_lock = 0;
 		h->b_uptodate = 0;
+		h->b_list = BUF_CLEAN;
+		h->b_reada = 0;
 		h->b_wait = NULL;
 		h->b_next = NULL;
 		h->b_prev = NULL;
+		h->b_reqnext = NULL;
 		h->b_data = (char *) b;
 		h->b_prev_free = h-1;
 		h->b_next_free = h+1;
@@ -410,9 +880,165 @@ void buffer_init(long buffer_end)
 			b = (void *) 0xA0000;
 	}
 	h--;
-	free_list = start_buffer;
-	free_list->b_prev_free = h;
-	h->b_next_free = free_list;
-	for (i=0;i<NR_HASH;i++)
+	lru_list[BUF_CLEAN] = start_buffer;
+	lru_list[BUF_CLEAN]->b_prev_free = h;
+	h->b_next_free = lru_list[BUF_CLEAN];
+	nr_buffers_type[BUF_CLEAN] = NR_BUFFERS;
+	nr_static_buffers = nr_buffer_heads = NR_BUFFERS;
+	for (i=0;i<nr_hash;i++)
 		hash_table[i]=NULL;
+}
+
+/*
+ * hash_chain_stat() walks the hash table: 'used' is the number of
+ * non-empty chains, 'total' the number of hashed buffers and 'max' the
+ * longest chain. total/used is the average cost of a successful lookup.
+ */
+void hash_chain_stat(int * used, int * total, int * max)
+{
+	struct buffer_head * bh;
+	int i, len;
+
+	*used = *total = *max = 0;
+	for (i=0 ; i<nr_hash ; i++) {
+		for (len=0, bh=hash_table[i] ; bh ; bh=bh->b_next)
+			len++;
+		if (!len)
+			continue;
+		(*used)++;
+		*total += len;
+		if (len > *max)
+			*max = len;
+	}
+}
+
+void show_buffers(void)
+{
+	int used, total, max;
+
+	printk("Buffer lists: %d clean, %d locked, %d dirty\n\r",
+		nr_buffers_type[BUF_CLEAN],nr_buffers_type[BUF_LOCKED],
+		nr_buffers_type[BUF_DIRTY]);
+	printk("getblk: %d misses, %d list nodes visited\n\r",
+		nr_getblk_miss,nr_getblk_visit);
+	printk("getblk: %d dirty victims, %d ticks waiting on them\n\r",
+		nr_getblk_dirty,getblk_dirty_ticks);
+	printk("%d buffers, %d of them in %d grown pages\n\r",
+		NR_BUFFERS,NR_BUFFERS-nr_static_buffers,nr_grown_pages);
+	hash_chain_stat(&used,&total,&max);
+	printk("hash: %d chains, %d used, avg length %d.%02d, max %d\n\r",
+		nr_hash,used,used ? total/used : 0,
+		used ? (total*100/used)%100 : 0,max);
+}
+
+/*
+ * sys_bufstat() copies the statistics of slot 'nr' to user space, or
+ * clears all of them if nr is negative. See <sys/bufstat.h>.
+ */
+int sys_bufstat(int nr, struct buffer_stat * bs)
+{
+	int i;
+
+	if (nr < 0) {
+		if (!suser())
+			return -EPERM;
+		memset(bstat,0,sizeof(bstat));
+		return 0;
+	}
+	if (nr >= NR_BUFSTAT)
+		return -EINVAL;
+	verify_area(bs,sizeof (* bs));
+	for (i=0 ; i<sizeof (* bs) ; i++)
+		put_fs_byte(((char *) &bstat[nr])[i],&((char *) bs)[i]);
+	return 0;
+}
+
+/*
+ * write_old_buffers() is one pass of the bdflush daemon over the dirty
+ * list. It writes the buffers whose flush time has come, or the oldest
+ * ones if there are too many dirty buffers altogether. WRITEA is used so
+ * that ll_rw_block() never sleeps under us: if the request queue is full
+ * the buffer is simply left dirty, and we wait for a free request and
+ * start over.
+ */
+static void write_old_buffers(void)
+{
+	struct buffer_head * bh, * next;
+	int i, ndirty;
+
+repeat:
+	ndirty = bdf_prm[3];
+	bh = lru_list[BUF_DIRTY];
+	for (i = nr_buffers_type[BUF_DIRTY] ; i-- > 0 ; bh = next) {
+		next = bh->b_next_free;
+		if (bh->b_count || bh->b_lock)
+			continue;
+		if (!bh->b_dirt) {
+			refile_buffer(bh);
+			continue;
+		}
+		if (too_many_dirty()) {
+			if (ndirty-- <= 0)
+				break;
+		} else if (bh->b_flushtime > jiffies)
+			continue;
+		ll_rw_block(WRITEA,bh);
+		if (bh->b_dirt) {
+			sleep_on(&wait_for_request);
+			goto repeat;
+		}
+		refile_buffer(bh);
+	}
+}
+
+static void bdflush_timer(void)
+{
+	bdflush_timer_pending = 0;
+	wake_up(&bdflush_wait);
+}
+
+/*
+ * sys_bdflush() is the buffer writeback daemon, and its tuning knobs.
+ * func 0 turns the caller into the daemon (init forks it at boot) and
+ * never returns, func 1 does a single writeback pass. For func >= 2,
+ * (func-2)/2 is the bdf_prm[] entry: even reads it into *data, odd sets
+ * it to data.
+ */
+int sys_bdflush(int func, long data)
+{
+	int i;
+
+	if (!suser())
+		return -EPERM;
+	if (func == 1) {
+		write_old_buffers();
+		return 0;
+	}
+	if (func >= 2) {
+		i = (func-2) >> 1;
+		if (i >= NR_BDF_PARAM)
+			return -EINVAL;
+		if (!(func & 1)) {
+			verify_area((void *) data,4);
+			put_fs_long(bdf_prm[i],(unsigned long *) data);
+			return 0;
+		}
+		if (data < bdf_min[i] || data > bdf_max[i])
+			return -EINVAL;
+		bdf_prm[i] = data;
+		return 0;
+	}
+	if (func || bdflush_task)
+		return -EBUSY;
+	bdflush_task = current;
+	for (;;) {
+		write_old_buffers();
+		cli();
+		if (!bdflush_timer_pending) {
+			bdflush_timer_pending = 1;
+			add_timer(bdf_prm[0],&bdflush_timer);
+		}
+		sti();
+		sleep_on(&bdflush_wait);
+	}
 }	
@@ -0,0 +1,164 @@
+/*
+ *  linux/fs/dcache.c
+ */
+
+/*
+ * dcache.c remembers what names in directories turned out to be, so
+ * that namei() doesn't have to scan the directory every time somebody
+ * looks at the same path. An entry is named by the device, the inode
+ * number of the directory and the name, and holds the inode number the
+ * name has there - or 0, if the name isn't there: looking for things
+ * that don't exist (include paths, PATH searches) is just as common.
+ *
+ * Entries are only ever dropped, never changed: add_entry() and the
+ * code removing names drop the entry of the name, rmdir drops all the
+ * entries of the directory, and umount or a media change those of the
+ * device. A lookup that slept reading the directory doesn't remember
+ * what it found if anything was dropped meanwhile, see dcache_add().
+ */
+
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+#define NR_DCACHE	256
+#define NR_DHASH	61
+
+static struct dcache_entry {
+	unsigned short dev;		/* 0 = unused */
+	unsigned short dir;
+	unsigned short inr;
+	unsigned char len;
+	unsigned char referenced;
+	char name[NAME_LEN];
+	struct dcache_entry * next;	/* hash chain */
+} dcache[NR_DCACHE];
+
+static struct dcache_entry * dhash[NR_DHASH];
+static struct dcache_entry * dclock = dcache;
+/* bumped by every drop, see dcache_add() */
+unsigned long dcache_generation = 0;
+
+static unsigned int dhashfn(int dev, int dir, const char * name, int len)
+{
+	unsigned int h = dev ^ dir;
+
+	while (len--)
+		h = (h << 3) ^ (h >> 28) ^ (unsigned char) *name++;
+	return h % NR_DHASH;
+}
+
+static struct dcache_entry * find_dentry(int dev, int dir,
+	const char * name, int len)
+{
+	struct dcache_entry * d;
+
+	for (d = dhash[dhashfn(dev,dir,name,len)] ; d ; d = d->next)
+		if (d->dev == dev && d->dir == dir && d->len == len &&
+		    !strncmp(d->name,name,len))
+			return d;
+	return NULL;
+}
+
+static void remove_dentry(struct dcache_entry * d)
+{
+	struct dcache_entry ** dp;
+
+	for (dp = &dhash[dhashfn(d->dev,d->dir,d->name,d->len)] ; *dp ;
+	    dp = &(*dp)->next)
+		if (*dp == d) {
+			*dp = d->next;
+			break;
+		}
+	d->dev = 0;
+	d->next = NULL;
+}
+
+/*
+ * dcache_lookup() returns the inode number of the name (in kernel space)
+ * in dir, 0 if it is known not to be there, or -1 if we don't know.
+ */
+int dcache_lookup(struct m_inode * dir, const char * name, int len)
+{
+	struct dcache_entry * d;
+
+	if (len > NAME_LEN)
+		len = NAME_LEN;
+	if (!(d = find_dentry(dir->i_dev,dir->i_num,name,len)))
+		return -1;
+	d->referenced = 1;
+	return d->inr;
+}
+
+/*
+ * dcache_add() remembers that name is inr in dir, unless something was
+ * dropped since 'generation' was read from dcache_generation: then what
+ * the caller found might already be wrong. Entries are replaced by a
+ * clock, as in page_cache.c.
+ */
+void dcache_add(struct m_inode * dir, const char * name, int len, int inr,
+	unsigned long generation)
+{
+	struct dcache_entry * d;
+
+	if (generation != dcache_generation)
+		return;
+	if (len > NAME_LEN)
+		len = NAME_LEN;
+	if (find_dentry(dir->i_dev,dir->i_num,name,len))
+		return;
+	for (;;) {
+		d = dclock;
+		if (++dclock >= dcache + NR_DCACHE)
+			dclock = dcache;
+		if (!d->dev)
+			break;
+		if (!d->referenced) {
+			remove_dentry(d);
+			break;
+		}
+		d->referenced = 0;
+	}
+	d->dev = dir->i_dev;
+	d->dir = dir->i_num;
+	d->inr = inr;
+	d->len = len;
+	d->referenced = 1;
+	strncpy(d->name,name,len);
+	d->next = dhash[dhashfn(d->dev,d->dir,name,len)];
+	dhash[dhashfn(d->dev,d->dir,name,len)] = d;
+}
+
+/* dcache_remove() drops the entry of name (in kernel space) in dir */
+void dcache_remove(struct m_inode * dir, const char * name, int len)
+{
+	struct dcache_entry * d;
+
+	dcache_generation++;
+	if (len > NAME_LEN)
+		len = NAME_LEN;
+	if ((d = find_dentry(dir->i_dev,dir->i_num,name,len)))
+		remove_dentry(d);
+}
+
+/* dcache_remove_dir() drops everything about the names in a directory */
+void dcache_remove_dir(struct m_inode * dir)
+{
+	struct dcache_entry * d;
+
+	dcache_generation++;
+	for (d = dcache ; d < dcache + NR_DCACHE ; d++)
+		if (d->dev == dir->i_dev && d->dir == dir->i_num)
+			remove_dentry(d);
+}
+
+void dcache_invalidate_dev(int dev)
+{
+	struct dcache_entry * d;
+
+	dcache_generation++;
+	for (d = dcache ; d < dcache + NR_DCACHE ; d++)
+		if (d->dev && d->dev == dev)
+			remove_dentry(d);
+}
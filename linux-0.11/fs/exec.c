@@ -327,10 +327,9 @@ restart_interp:
 	current->executable = inode;
 	for (i=0 ; i<32 ; i++)
 		current->sigaction[i].sa_handler = NULL;
-	for (i=0 ; i<NR_OPEN ; i++)
-		if ((current->close_on_exec>>i)&1)
+	for (i=0 ; i<current->max_fds ; i++)
+		if (fd_bit(i,current->close_on_exec))
 			sys_close(i);
-	current->close_on_exec = 0;
 	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
 	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
 	if (last_task_used_math == current)
@@ -6,6 +6,8 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
@@ -14,15 +16,82 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
+/* readahead window limits, in blocks */
+#define READA_MIN	2
+#define READA_MAX	16
+
+/*
+ * file_readahead() looks at which blocks of the file are read now, block
+ * to last. A reader that continues where it left off gets its readahead
+ * window doubled (up to READA_MAX), and READA is started for the mapped
+ * blocks in the window after 'last' that haven't been asked for yet -
+ * nor are already in memory: everything before 'loaded' is. Anybody else
+ * is a random reader, and gets no readahead at all until it reads
+ * sequentially again.
+ */
+static void file_readahead(struct m_inode * inode, struct file * filp,
+	int block, int last, int loaded)
+{
+	int end, nr;
+
+	if (block == filp->f_ranext)
+		filp->f_rawin = filp->f_rawin ?
+			MIN(filp->f_rawin*2,READA_MAX) : READA_MIN;
+	else if (block != filp->f_ranext-1) {
+		filp->f_rawin = 0;
+		filp->f_raend = loaded;
+	}
+	filp->f_ranext = last+1;
+	if (!filp->f_rawin)
+		return;
+	end = MIN(last+1+filp->f_rawin,
+		(inode->i_size+BLOCK_SIZE-1)/BLOCK_SIZE);
+	if (filp->f_raend < loaded)
+		filp->f_raend = loaded;
+	for ( ; filp->f_raend < end ; filp->f_raend++)
+		if ((nr = bmap(inode,filp->f_raend)))
+			read_ahead(inode->i_dev,nr);
+}
+
+/*
+ * Regular files are read a page at a time out of the page cache. If
+ * there's no memory for a page, we fall back to reading the block
+ * through the buffer cache. Directories always go that way, as namei
+ * changes them in the buffers directly.
+ */
 int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
-	int left,chars,nr;
+	int left,chars,nr,block;
 	struct buffer_head * bh;
+	unsigned long page;
+	char * p;
 
 	if ((left=count)<=0)
 		return 0;
 	while (left) {
-		if ((nr = bmap(inode,(filp->f_pos)/BLOCK_SIZE))) {
+		block = (filp->f_pos)/BLOCK_SIZE;
+		page = 0;
+		if (S_ISREG(inode->i_mode)) {
+			nr = filp->f_pos % PAGE_SIZE;
+			chars = MIN( PAGE_SIZE-nr , left );
+/* the page holds blocks (block&~3) to (block|3) */
+			file_readahead(inode,filp,block,
+				(filp->f_pos+chars-1)/BLOCK_SIZE,(block|3)+1);
+/* without it only this block is read below: the reader goes on after it */
+			if (!(page = get_cache_page(inode,block & ~3)))
+				filp->f_ranext = block+1;
+		} else
+			file_readahead(inode,filp,block,block,block+1);
+		if (page) {
+			filp->f_pos += chars;
+			left -= chars;
+			p = nr + (char *) page;
+			while (chars-->0)
+				put_fs_byte(*(p++),buf++);
+			free_page(page);
+			continue;
+		}
+		if ((nr = bmap(inode,block))) {
 			if (!(bh=bread(inode->i_dev,nr)))
 				break;
 		} else
@@ -32,7 +101,7 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 		filp->f_pos += chars;
 		left -= chars;
 		if (bh) {
-			char * p = nr + bh->b_data;
+			p = nr + bh->b_data;
 			while (chars-->0)
 				put_fs_byte(*(p++),buf++);
 			brelse(bh);
@@ -48,10 +117,10 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 int file_write(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
 	off_t pos;
-	int block,c;
+	int block,nr,c;
 	struct buffer_head * bh;
 	char * p;
-	int i=0;`
+	int i=0;
 
 /*
  * ok, append may not work when many processes are writing at the same time
@@ -62,12 +131,26 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 	else
 		pos = filp->f_pos;
 	while (i<count) {
-		if (!(block = create_block(inode,pos/BLOCK_SIZE)))
+		nr = pos/BLOCK_SIZE;
+		if (!(block = create_block(inode,nr)))
 			break;
-		if (!(bh=bread(inode->i_dev,block)))
+		c = pos % BLOCK_SIZE;
+/*
+ * There is no need to read the block if all of it gets overwritten, or
+ * if it starts at or after the end of the file: then nothing in it is
+ * file data yet (this is the case for all blocks create_block() just
+ * allocated), and it only has to be zeroed. A block that gets overwritten
+ * is zeroed too: it's uptodate and dirty before get_fs_byte() (which can
+ * fault) is done, and the buffer may hold some other block's data.
+ */
+		if ((!c && count-i >= BLOCK_SIZE) || pos-c >= inode->i_size) {
+			bh = getblk(inode->i_dev,block);
+			if (!bh->b_uptodate)
+				memset(bh->b_data,0,BLOCK_SIZE);
+		} else if (!(bh=bread(inode->i_dev,block)))
 			break;
-		c = pos % BLOCK_SIZE;WT54 
 		p = c + bh->b_data;
+		bh->b_uptodate = 1;
 		bh->b_dirt = 1;
 		c = BLOCK_SIZE-c;
 		if (c > count-i) c = count-i;
@@ -79,6 +162,11 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 		i += c;
 		while (c-->0)
 			*(p++) = get_fs_byte(buf++);
+/*
+ * Only now is the page cache told: get_fs_byte() can sleep, and a reader
+ * could cache the half-written block meanwhile.
+ */
+		invalidate_cache_pages(inode,nr);
 		brelse(bh);
 	}
 	inode->i_mtime = CURRENT_TIME;
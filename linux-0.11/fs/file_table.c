@@ -4,6 +4,119 @@
  *  (C) 1991  Linus Torvalds
  */
 
+/*
+ * The file structures are file_table and, when those run out, pages of
+ * them from get_free_page(), never given back. The unused ones are on
+ * free_files, so getting one doesn't search anything.
+ *
+ * The descriptors of a process are in its filp[], which is the
+ * fd_array in the task_struct until a process wants more than
+ * NR_OPEN_DEFAULT of them: then it gets a page of NR_OPEN pointers.
+ * open_fds has a bit for every descriptor in use, and the lowest free
+ * one is found a word at a time.
+ */
+
+#include <errno.h>
+#include <string.h>
+
 #include <linux/fs.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+
+#define FILES_PER_PAGE	(PAGE_SIZE/sizeof(struct file))
+#define MAX_FILE_PAGES	32
+#define FGROW_MIN_FREE	256	/* free pages always left to everybody else */
 
 struct file file_table[NR_FILE];
+static struct file * free_files = NULL;
+static int nr_files = 0;
+
+static int grow_files(void)
+{
+	struct file * f;
+	int i;
+
+	if (nr_files >= NR_FILE + MAX_FILE_PAGES*FILES_PER_PAGE ||
+	    nr_free_pages <= FGROW_MIN_FREE)
+		return 0;
+	if (!(f = (struct file *) get_free_page()))
+		return 0;
+	for (i = 0 ; i < FILES_PER_PAGE ; i++)
+		put_filp(f + i);
+	nr_files += FILES_PER_PAGE;
+	return 1;
+}
+
+struct file * get_empty_filp(void)
+{
+	struct file * f;
+
+	if (!nr_files)
+		for ( ; nr_files < NR_FILE ; nr_files++)
+			put_filp(file_table + nr_files);
+	if (!free_files && !grow_files())
+		return NULL;
+	f = free_files;
+	free_files = f->f_next;
+	memset(f,0,sizeof(*f));
+	f->f_count = 1;
+	return f;
+}
+
+void put_filp(struct file * f)
+{
+	f->f_count = 0;
+	f->f_next = free_files;
+	free_files = f;
+}
+
+static int grow_fds(void)
+{
+	struct file ** filp;
+	int i;
+
+	if (current->max_fds >= NR_OPEN)
+		return 0;
+	if (!(filp = (struct file **) get_free_page()))
+		return 0;
+	for (i = 0 ; i < current->max_fds ; i++)
+		filp[i] = current->filp[i];
+	current->filp = filp;
+	current->max_fds = NR_OPEN;
+	return 1;
+}
+
+/*
+ * get_unused_fd() takes the lowest free descriptor not below start,
+ * with close-on-exec cleared. filp[] of it is still NULL: the caller
+ * fills it in, or gives the descriptor back with put_unused_fd().
+ */
+int get_unused_fd(unsigned int start)
+{
+	unsigned long word;
+	int fd;
+
+	if (start >= NR_OPEN)
+		return -EINVAL;
+	fd = start & ~31;
+	word = current->open_fds[fd>>5] | ((1UL << (start & 31)) - 1);
+	while (word == ~0UL) {
+		if ((fd += 32) >= NR_OPEN)
+			return -EMFILE;
+		word = current->open_fds[fd>>5];
+	}
+	__asm__("bsfl %1,%0":"=r" (word):"r" (~word));
+	fd += word;
+	if (fd >= current->max_fds && !grow_fds())
+		return -EMFILE;
+	set_fd_bit(fd,current->open_fds);
+	clear_fd_bit(fd,current->close_on_exec);
+	return fd;
+}
+
+void put_unused_fd(int fd)
+{
+	current->filp[fd] = NULL;
+	clear_fd_bit(fd,current->open_fds);
+	clear_fd_bit(fd,current->close_on_exec);
+}
@@ -5,14 +5,41 @@
  */
 
 #include <string.h> 
+#include <errno.h>
 #include <sys/stat.h>
+#include <sys/inodestat.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <linux/mm.h>
 #include <asm/system.h>
+#include <asm/segment.h>
+
+/*
+ * The in-core inodes are inode_table and, when that isn't enough, pages
+ * of them from get_free_page() - up to MAX_INODE_PAGES, as long as there
+ * is plenty of memory. They are never given back. iget() finds inodes
+ * through a hash of (dev,nr), and the unused ones are on an lru list,
+ * so get_empty_inode() doesn't have to search for them either: it takes
+ * the least recently used one that is clean, and grows the table before
+ * it writes one out.
+ */
+#define INODES_PER_PAGE	(PAGE_SIZE/sizeof(struct m_inode))
+#define MAX_INODE_PAGES	64
+#define NR_IHASH	307
+#define IGROW_MIN_FREE	256	/* free pages always left to everybody else */
 
 struct m_inode inode_table[NR_INODE]={{0,},};
+static struct m_inode * inode_pages[MAX_INODE_PAGES] = {NULL,};
+static struct m_inode * inode_hash[NR_IHASH] = {NULL,};
+static struct m_inode * unused_inodes = NULL;	/* lru first */
+static int nr_inodes = 0;
+static int nr_inode_pages = 0;
+static unsigned long inode_lookups = 0;
+static unsigned long inode_hits = 0;
+
+#define _ihashfn(dev,nr) (((unsigned)((dev)^(nr)))%NR_IHASH)
+#define ihash(dev,nr) inode_hash[_ihashfn(dev,nr)]
 
 static void read_inode(struct m_inode * inode);
 static void write_inode(struct m_inode * inode);
@@ -40,17 +67,130 @@ static inline void unlock_inode(struct m_inode * inode)
 	wake_up(&inode->i_wait);
 }
 
+/*
+ * nth_inode() is how to walk all the in-core inodes: the first ones are
+ * inode_table, the rest are in inode_pages.
+ */
+static inline struct m_inode * nth_inode(int i)
+{
+	if (i < NR_INODE)
+		return inode_table + i;
+	i -= NR_INODE;
+	return inode_pages[i / INODES_PER_PAGE] + i % INODES_PER_PAGE;
+}
+
+static void remove_from_hash(struct m_inode * inode)
+{
+	struct m_inode ** p;
+
+	for (p = &ihash(inode->i_dev,inode->i_num) ; *p ; p = &(*p)->i_next)
+		if (*p == inode) {
+			*p = inode->i_next;
+			break;
+		}
+	inode->i_next = NULL;
+}
+
+void insert_inode_hash(struct m_inode * inode)
+{
+	inode->i_next = ihash(inode->i_dev,inode->i_num);
+	ihash(inode->i_dev,inode->i_num) = inode;
+}
+
+static void remove_from_unused(struct m_inode * inode)
+{
+	if (!inode->i_next_free)
+		return;
+	if (inode->i_next_free == inode)
+		unused_inodes = NULL;
+	else {
+		inode->i_prev_free->i_next_free = inode->i_next_free;
+		inode->i_next_free->i_prev_free = inode->i_prev_free;
+		if (unused_inodes == inode)
+			unused_inodes = inode->i_next_free;
+	}
+	inode->i_next_free = inode->i_prev_free = NULL;
+}
+
+static void put_last_unused(struct m_inode * inode)
+{
+	remove_from_unused(inode);
+	if (!unused_inodes) {
+		unused_inodes = inode->i_next_free = inode->i_prev_free = inode;
+		return;
+	}
+	inode->i_next_free = unused_inodes;
+	inode->i_prev_free = unused_inodes->i_prev_free;
+	unused_inodes->i_prev_free->i_next_free = inode;
+	unused_inodes->i_prev_free = inode;
+}
+
+/* an inode without contents is the best one to use next */
+static void put_first_unused(struct m_inode * inode)
+{
+	put_last_unused(inode);
+	unused_inodes = inode;
+}
+
+/*
+ * clear_inode() empties an inode whose last user is done with it, which
+ * is what free_inode() does once the inode is gone from the disk.
+ */
+void clear_inode(struct m_inode * inode)
+{
+	remove_from_hash(inode);
+	remove_from_unused(inode);
+	memset(inode,0,sizeof(*inode));
+	put_first_unused(inode);
+}
+
+static void init_inodes(void)
+{
+	for (nr_inodes = 0 ; nr_inodes < NR_INODE ; nr_inodes++)
+		put_last_unused(inode_table + nr_inodes);
+}
+
+static int grow_inodes(void)
+{
+	struct m_inode * inode;
+	int i;
+
+	if (nr_inode_pages >= MAX_INODE_PAGES || nr_free_pages <= IGROW_MIN_FREE)
+		return 0;
+	if (!(inode = (struct m_inode *) get_free_page()))
+		return 0;
+	inode_pages[nr_inode_pages++] = inode;
+	for (i = 0 ; i < INODES_PER_PAGE ; i++)
+		put_first_unused(inode + i);
+	nr_inodes += INODES_PER_PAGE;
+	return 1;
+}
+
+int inodes_busy(int dev)
+{
+	struct m_inode * inode;
+	int i;
+
+	for (i = 0 ; i < nr_inodes ; i++) {
+		inode = nth_inode(i);
+		if (inode->i_dev == dev && inode->i_count)
+			return 1;
+	}
+	return 0;
+}
+
 void invalidate_inodes(int dev)
 {
 	int i;
 	struct m_inode * inode;
 
-	inode = 0+inode_table;
-	for(i=0 ; i<NR_INODE ; i++,inode++) {
+	for(i=0 ; i<nr_inodes ; i++) {
+		inode = nth_inode(i);
 		wait_on_inode(inode);
 		if (inode->i_dev == dev) {
 			if (inode->i_count)
 				printk("inode in use on removed disk\n\r");
+			remove_from_hash(inode);
 			inode->i_dev = inode->i_dirt = 0;
 		}
 	}
@@ -61,8 +201,8 @@ void sync_inodes(void)
 	int i;
 	struct m_inode * inode;
 
-	inode = 0+inode_table;
-	for(i=0 ; i<NR_INODE ; i++,inode++) {
+	for(i=0 ; i<nr_inodes ; i++) {
+		inode = nth_inode(i);
 		wait_on_inode(inode);
 		if (inode->i_dirt && !inode->i_pipe)
 			write_inode(inode);
@@ -72,7 +212,8 @@ void sync_inodes(void)
 static int _bmap(struct m_inode * inode,int block,int create)
 {
 	struct buffer_head * bh;
-	int i;
+	unsigned short * zone;
+	int i, ind;
 
 	if (block<0)
 		panic("_bmap: block<0");
@@ -80,7 +221,8 @@ static int _bmap(struct m_inode * inode,int block,int create)
 		panic("_bmap: block>big");
 	if (block<7) {
 		if (create && !inode->i_zone[block])
-			if ((inode->i_zone[block]=new_block(inode->i_dev))) {
+			if ((inode->i_zone[block]=new_file_block(inode,
+			    block ? inode->i_zone[block-1] : 0))) {
 				inode->i_ctime=CURRENT_TIME;
 				inode->i_dirt=1;
 			}
@@ -89,7 +231,7 @@ static int _bmap(struct m_inode * inode,int block,int create)
 	block -= 7;
 	if (block<512) {
 		if (create && !inode->i_zone[7])
-			if ((inode->i_zone[7]=new_block(inode->i_dev))) {
+			if ((inode->i_zone[7]=new_file_block(inode,inode->i_zone[6]))) {
 				inode->i_dirt=1;
 				inode->i_ctime=CURRENT_TIME;
 			}
@@ -97,10 +239,12 @@ static int _bmap(struct m_inode * inode,int block,int create)
 			return 0;
 		if (!(bh = bread(inode->i_dev,inode->i_zone[7])))
 			return 0;
-		i = ((unsigned short *) (bh->b_data))[block];
+		zone = (unsigned short *) bh->b_data;
+		i = zone[block];
 		if (create && !i)
-			if ((i=new_block(inode->i_dev))) {
-				((unsigned short *) (bh->b_data))[block]=i;
+			if ((i=new_file_block(inode,
+			    block ? zone[block-1] : inode->i_zone[7]))) {
+				zone[block]=i;
 				bh->b_dirt=1;
 			}
 		brelse(bh);
@@ -108,7 +252,7 @@ static int _bmap(struct m_inode * inode,int block,int create)
 	}
 	block -= 512;
 	if (create && !inode->i_zone[8])
-		if ((inode->i_zone[8]=new_block(inode->i_dev))) {
+		if ((inode->i_zone[8]=new_file_block(inode,inode->i_zone[7]))) {
 			inode->i_dirt=1;
 			inode->i_ctime=CURRENT_TIME;
 		}
@@ -116,21 +260,25 @@ static int _bmap(struct m_inode * inode,int block,int create)
 		return 0;
 	if (!(bh=bread(inode->i_dev,inode->i_zone[8])))
 		return 0;
-	i = ((unsigned short *)bh->b_data)[block>>9];
+	zone = (unsigned short *) bh->b_data;
+	i = zone[block>>9];
 	if (create && !i)
-		if ((i=new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block>>9]=i;
+		if ((i=new_file_block(inode,
+		    (block>>9) ? zone[(block>>9)-1] : inode->i_zone[8]))) {
+			zone[block>>9]=i;
 			bh->b_dirt=1;
 		}
 	brelse(bh);
 	if (!i)
 		return 0;
-	if (!(bh=bread(inode->i_dev,i)))
+	if (!(bh=bread(inode->i_dev,ind=i)))
 		return 0;
-	i = ((unsigned short *)bh->b_data)[block&511];
+	zone = (unsigned short *) bh->b_data;
+	i = zone[block&511];
 	if (create && !i)
-		if ((i=new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block&511]=i;
+		if ((i=new_file_block(inode,
+		    (block&511) ? zone[(block&511)-1] : ind))) {
+			zone[block&511]=i;
 			bh->b_dirt=1;
 		}
 	brelse(bh);
@@ -162,10 +310,12 @@ void iput(struct m_inode * inode)
 		inode->i_count=0;
 		inode->i_dirt=0;
 		inode->i_pipe=0;
+		put_first_unused(inode);
 		return;
 	}
 	if (!inode->i_dev) {
-		inode->i_count--;
+		if (!--inode->i_count)
+			put_first_unused(inode);
 		return;
 	}
 	if (S_ISBLK(inode->i_mode)) {
@@ -177,6 +327,10 @@ repeat:
 		inode->i_count--;
 		return;
 	}
+	if (inode->i_prealloc_count) {
+		discard_prealloc(inode);	/* can sleep too */
+		goto repeat;
+	}
 	if (!inode->i_nlinks) {
 		truncate(inode);
 		free_inode(inode);
@@ -188,30 +342,37 @@ repeat:
 		goto repeat;
 	}
 	inode->i_count--;
+	put_last_unused(inode);
 	return;
 }
 
 struct m_inode * get_empty_inode(void)
 {
 	struct m_inode * inode;
-	static struct m_inode * last_inode = inode_table;
 	int i;
 
+	if (!nr_inodes)
+		init_inodes();
 	do {
 		inode = NULL;
-		for (i = NR_INODE; i ; i--) { /* NR_INODE = 32 */
-			if (++last_inode >= inode_table + NR_INODE)
-				last_inode = inode_table;
-			if (!last_inode->i_count) {
-				inode = last_inode;
-				if (!inode->i_dirt && !inode->i_lock)
-					break;
+		for (i = nr_inodes ; i-- > 0 && unused_inodes ; ) {
+			inode = unused_inodes;
+			if (inode->i_count) {	/* somebody took it */
+				remove_from_unused(inode);
+				inode = NULL;
+				continue;
 			}
+			if (!inode->i_dirt && !inode->i_lock)
+				break;
+			put_last_unused(inode);
+			inode = NULL;
 		}
-		if (!inode) {
-			for (i=0 ; i<NR_INODE ; i++)
-				printk("%04x: %6d\t",inode_table[i].i_dev,
-					inode_table[i].i_num);
+		if (!inode && grow_inodes())
+			continue;
+		if (!inode && !(inode = unused_inodes)) {
+			for (i=0 ; i<nr_inodes ; i++)
+				printk("%04x: %6d\t",nth_inode(i)->i_dev,
+					nth_inode(i)->i_num);
 			panic("No free inodes in mem");
 		}
 		wait_on_inode(inode);
@@ -219,7 +380,9 @@ struct m_inode * get_empty_inode(void)
 			write_inode(inode);
 			wait_on_inode(inode);
 		}
-	} while (inode->i_count);
+	} while (!inode || inode->i_count);
+	remove_from_hash(inode);
+	remove_from_unused(inode);
 	memset(inode,0,sizeof(*inode));
 	inode->i_count = 1;
 	return inode;
@@ -232,7 +395,7 @@ struct m_inode * get_pipe_inode(void)
 	if (!(inode = get_empty_inode()))
 		return NULL;
 	if (!(inode->i_size=get_free_page())) {
-		inode->i_count = 0;
+		iput(inode);
 		return NULL;
 	}
 	inode->i_count = 2;	/* sum of readers/writers */
@@ -243,22 +406,21 @@ struct m_inode * get_pipe_inode(void)
 
 struct m_inode * iget(int dev,int nr)
 {
-	struct m_inode * inode, * empty;
+	struct m_inode * inode, * empty = NULL;
 
 	if (!dev)
 		panic("iget with dev==0");
-	empty = get_empty_inode();
-	inode = inode_table;
-	while (inode < NR_INODE+inode_table) {
-		if (inode->i_dev != dev || inode->i_num != nr) {
-			inode++;
-			continue;
-		}
+	inode_lookups++;
+repeat:
+	for (inode = ihash(dev,nr) ; inode ; inode = inode->i_next)
+		if (inode->i_dev == dev && inode->i_num == nr)
+			break;
+	if (inode) {
 		wait_on_inode(inode);
-		if (inode->i_dev != dev || inode->i_num != nr) {
-			inode = inode_table;
-			continue;
-		}
+		if (inode->i_dev != dev || inode->i_num != nr)
+			goto repeat;
+		if (!inode->i_count)
+			remove_from_unused(inode);
 		inode->i_count++;
 		if (inode->i_mount) {
 			int i;
@@ -275,22 +437,53 @@ struct m_inode * iget(int dev,int nr)
 			iput(inode);
 			dev = super_block[i].s_dev;
 			nr = ROOT_INO;
-			inode = inode_table;
-			continue;
+			goto repeat;
 		}
 		if (empty)
 			iput(empty);
+		else
+			inode_hits++;
 		return inode;
 	}
-	if (!empty)
-		return (NULL);
+/* get_empty_inode() can sleep, and somebody else read the inode meanwhile */
+	if (!empty) {
+		if (!(empty = get_empty_inode()))
+			return NULL;
+		goto repeat;
+	}
 	inode=empty;
 	inode->i_dev = dev;
 	inode->i_num = nr;
+	insert_inode_hash(inode);
 	read_inode(inode);
 	return inode;
 }
 
+int sys_inodestat(struct inode_stat * is)
+{
+	struct inode_stat s;
+	int i;
+
+	if (!is) {
+		if (!suser())
+			return -EPERM;
+		inode_lookups = inode_hits = 0;
+		return 0;
+	}
+	s.is_inodes = nr_inodes;
+	s.is_used = 0;
+	for (i = 0 ; i < nr_inodes ; i++)
+		if (nth_inode(i)->i_count)
+			s.is_used++;
+	s.is_pages = nr_inode_pages;
+	s.is_lookups = inode_lookups;
+	s.is_hits = inode_hits;
+	verify_area(is,sizeof (* is));
+	for (i=0 ; i<sizeof (* is) ; i++)
+		put_fs_byte(((char *) &s)[i],&((char *) is)[i]);
+	return 0;
+}
+
 static void read_inode(struct m_inode * inode)
 {
 	struct super_block * sb;
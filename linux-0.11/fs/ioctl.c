@@ -11,6 +11,7 @@
 #include <linux/sched.h>
 
 extern int tty_ioctl(int dev, int cmd, int arg);
+extern int blk_ioctl(int dev, int cmd, int arg);
 
 typedef int (*ioctl_ptr)(int dev,int cmd,int arg);
 
@@ -32,12 +33,14 @@ int sys_ioctl(unsigned int fd, unsigned int cmd, unsigned long arg)
 	struct file * filp;
 	int dev,mode;
 
-	if (fd >= NR_OPEN || !(filp = current->filp[fd]))
+	if (fd >= current->max_fds || !(filp = current->filp[fd]))
 		return -EBADF;
 	mode=filp->f_inode->i_mode;
 	if (!S_ISCHR(mode) && !S_ISBLK(mode))
 		return -EINVAL;
 	dev = filp->f_inode->i_zone[0];
+	if (S_ISBLK(mode))
+		return blk_ioctl(dev,cmd,arg);
 	if (MAJOR(dev) >= NRDEVS)
 		return -ENODEV;
 	if (!ioctl_table[MAJOR(dev)])
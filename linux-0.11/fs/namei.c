@@ -77,6 +77,166 @@ static int match(int len,const char * name,struct dir_entry * de)
 	return same;
 }
 
+/*
+ * Indexed directories.
+ *
+ * A directory that outgrows its first block doesn't grow linearly: the
+ * names that don't fit in block 0 go into hash buckets, one block each,
+ * in levels of DX_BUCKETS, 2*DX_BUCKETS, 4*DX_BUCKETS... buckets that
+ * follow each other in the file. A name can only be in block 0 or in its
+ * bucket of each level, so finding it takes a block per level, and the
+ * levels grow exponentially with the size of the directory. A new level
+ * is only opened when the name's bucket is full on every existing one.
+ *
+ * Buckets are only given blocks when something goes into them, and the
+ * rest of the file are holes that read as empty entries: to anything
+ * that reads the directory linearly, it is an ordinary directory. The
+ * mark is in the name of '.', after its terminating zero, where nobody
+ * looks: "HX" and the number of levels. Entries never move once they
+ * are in, as callers of find_entry() keep pointers to them across
+ * sleeps.
+ *
+ * Only filesystems mounted with MS_DIRINDEX get new indexed directories:
+ * kernels that don't know the format (or the host's minix driver) can
+ * read them, but entries they add may end up where we don't look, so
+ * it's for disks that only this kernel writes to. Directories that grew
+ * past their first block otherwise stay linear, and the ones already
+ * indexed are kept indexed wherever they are mounted.
+ */
+#define DX_BUCKETS	4
+#define DX_MAX_LEVELS	12
+/* the file block of bucket h of level k, or where level k starts */
+#define dx_block(h,k) (1 + DX_BUCKETS*((1<<(k))-1) + (h) % (DX_BUCKETS<<(k)))
+
+static int dx_levels(struct buffer_head * bh)
+{
+	struct dir_entry * de = (struct dir_entry *) bh->b_data;
+
+	if (de->name[0] != '.' || de->name[1] ||
+	    de->name[2] != 'H' || de->name[3] != 'X')
+		return 0;
+	return de->name[4];
+}
+
+/*
+ * can the directory be indexed: is its filesystem mounted with
+ * MS_DIRINDEX, and does it start with a plain '.'
+ */
+static int dx_ok(struct m_inode * dir, struct buffer_head * bh)
+{
+	struct dir_entry * de = (struct dir_entry *) bh->b_data;
+	struct super_block * sb;
+
+	if (!(sb = get_super(dir->i_dev)) || !sb->s_dirindex)
+		return 0;
+	return !strcmp(de->name,".") && !de->name[2] && !de->name[4];
+}
+
+static unsigned long dx_hash(const char * name, int namelen)
+{
+	unsigned long h = 0;
+
+	while (namelen--)
+		h = h*31 + (unsigned char) get_fs_byte(name++);
+	h ^= h >> 16;
+	return h ^ (h >> 8);
+}
+
+/* look for the name in all the entries of a block */
+static struct dir_entry * scan_block(struct buffer_head * bh,
+	const char * name, int namelen)
+{
+	struct dir_entry * de = (struct dir_entry *) bh->b_data;
+	int i;
+
+	for (i = 0 ; i < DIR_ENTRIES_PER_BLOCK ; i++,de++)
+		if (match(namelen,name,de))
+			return de;
+	return NULL;
+}
+
+/*
+ * dx_find_entry() is find_entry() for an indexed directory, bh being
+ * its block 0, which it releases.
+ */
+static struct buffer_head * dx_find_entry(struct m_inode * dir,
+	struct buffer_head * bh, const char * name, int namelen,
+	struct dir_entry ** res_dir)
+{
+	struct dir_entry * de;
+	unsigned long h;
+	int k, levels, block;
+
+	if ((de = scan_block(bh,name,namelen))) {
+		*res_dir = de;
+		return bh;
+	}
+	levels = dx_levels(bh);
+	brelse(bh);
+	h = dx_hash(name,namelen);
+	for (k = 0 ; k < levels ; k++) {
+		if (!(block = bmap(dir,dx_block(h,k))) ||
+		    !(bh = bread(dir->i_dev,block)))
+			continue;
+		if ((de = scan_block(bh,name,namelen))) {
+			*res_dir = de;
+			return bh;
+		}
+		brelse(bh);
+	}
+	return NULL;
+}
+
+/*
+ * dx_add_entry() is add_entry() for a directory whose block 0 (bh, which
+ * it releases) is full, and which is indexed or can be: one that is
+ * just that block.
+ */
+static struct buffer_head * dx_add_entry(struct m_inode * dir,
+	struct buffer_head * bh0, const char * name, int namelen,
+	struct dir_entry ** res_dir)
+{
+	struct dir_entry * dot = (struct dir_entry *) bh0->b_data;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	unsigned long h;
+	int k, i, block;
+
+	h = dx_hash(name,namelen);
+	for (k = 0 ; k < DX_MAX_LEVELS ; k++) {
+		if (k >= dx_levels(bh0)) {
+			dot->name[2] = 'H';
+			dot->name[3] = 'X';
+			dot->name[4] = k+1;
+			bh0->b_dirt = 1;
+			dir->i_size = dx_block(0,k+1) * BLOCK_SIZE;
+			dir->i_dirt = 1;
+			dir->i_ctime = CURRENT_TIME;
+		}
+		if (!(block = create_block(dir,dx_block(h,k))))
+			break;
+		if (!(bh = bread(dir->i_dev,block)))
+			continue;
+		de = (struct dir_entry *) bh->b_data;
+		for (i = 0 ; i < DIR_ENTRIES_PER_BLOCK ; i++,de++)
+			if (!de->inode)
+				break;
+		if (i < DIR_ENTRIES_PER_BLOCK) {
+			dir->i_mtime = CURRENT_TIME;
+			for (i=0; i < NAME_LEN ; i++)
+				de->name[i]=(i<namelen)?get_fs_byte(name+i):0;
+			dcache_remove(dir,de->name,namelen);
+			bh->b_dirt = 1;
+			brelse(bh0);
+			*res_dir = de;
+			return bh;
+		}
+		brelse(bh);
+	}
+	brelse(bh0);
+	return NULL;
+}
+
 /*
  *	find_entry()
  *
@@ -131,6 +291,8 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 		return NULL;
 	if (!(bh = bread((*dir)->i_dev,block))) /* 根据盘块号和设备号把磁盘数据读到缓冲区，并返回 */
 		return NULL;
+	if (dx_levels(bh)) /* 有索引的目录 */
+		return dx_find_entry(*dir,bh,name,namelen,res_dir);
 	i = 0;
 	de = (struct dir_entry *) bh->b_data; /* 拿到数据 */
 	while (i < entries) {
@@ -190,6 +352,9 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 	de = (struct dir_entry *) bh->b_data;
 	while (1) {
 		if ((char *)de >= BLOCK_SIZE+bh->b_data) {
+			if (i == DIR_ENTRIES_PER_BLOCK && (dx_levels(bh) ||
+			    (dir->i_size == BLOCK_SIZE && dx_ok(dir,bh))))
+				return dx_add_entry(dir,bh,name,namelen,res_dir);
 			brelse(bh);
 			bh = NULL;
 			block = create_block(dir,i/DIR_ENTRIES_PER_BLOCK);
@@ -211,6 +376,7 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 			dir->i_mtime = CURRENT_TIME;
 			for (i=0; i < NAME_LEN ; i++)
 				de->name[i]=(i<namelen)?get_fs_byte(name+i):0;
+			dcache_remove(dir,de->name,namelen);
 			bh->b_dirt = 1;
 			*res_dir = de;
 			return bh;
@@ -222,6 +388,51 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 	return NULL;
 }
 
+/*
+ *	lookup()
+ *
+ * returns the inode number of a name in a directory, or 0 if it isn't
+ * there, asking the dcache first. Like find_entry(), it can change *dir
+ * for '..': that, and '.', are never cached.
+ */
+static int lookup(struct m_inode ** dir, const char * name, int namelen)
+{
+	char buf[NAME_LEN];
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	unsigned long generation;
+	int inr, i;
+
+#ifdef NO_TRUNCATE
+	if (namelen > NAME_LEN)
+		return 0;
+#else
+	if (namelen > NAME_LEN)
+		namelen = NAME_LEN;
+#endif
+	for (i = 0 ; i < namelen ; i++)
+		buf[i] = get_fs_byte(name+i);
+	if (namelen && buf[0] == '.' &&
+	    (namelen == 1 || (namelen == 2 && buf[1] == '.'))) {
+		if (!(bh = find_entry(dir,name,namelen,&de)))
+			return 0;
+		inr = de->inode;
+		brelse(bh);
+		return inr;
+	}
+	if ((inr = dcache_lookup(*dir,buf,namelen)) >= 0)
+		return inr;
+	generation = dcache_generation;
+	if ((bh = find_entry(dir,name,namelen,&de))) {
+		inr = de->inode;
+		brelse(bh);
+	} else
+		inr = 0;
+	if (namelen)
+		dcache_add(*dir,buf,namelen,inr,generation);
+	return inr;
+}
+
 /*
  *	get_dir()
  *
@@ -233,9 +444,7 @@ static struct m_inode * get_dir(const char * pathname)
 	char c;
 	const char * thisname;
 	struct m_inode * inode;
-	struct buffer_head * bh;
 	int namelen,inr,idev;
-	struct dir_entry * de;
 
 	if (!current->root || !current->root->i_count) /* 当前进程没有根节点或者根节点的引用计数为 0 就停机 */
 		panic("No root inode");
@@ -262,14 +471,11 @@ static struct m_inode * get_dir(const char * pathname)
 
 		/* static struct buffer_head * find_entry(struct m_inode ** dir, const char * name, int namelen, struct dir_entry ** res_dir)*/
 		/* 找到 thisname 这个entry，并返回 entry 以及 包含该目录项的高速缓冲块。 */	
-		if (!(bh = find_entry(&inode,thisname,namelen,&de))) {
-			iput(inode); /* 如果该缓冲块为空，放回 inode 的节点 */
+		if (!(inr = lookup(&inode,thisname,namelen))) { /* 拿到 inode 节点号 inr */
+			iput(inode); /* 如果没找到，放回 inode 的节点 */
 			return NULL;
 		}
-
-		inr = de->inode; /* 拿到 inode 节点号 inr */
 		idev = inode->i_dev; /* 取出设备号 */
-		brelse(bh); /* 释放缓冲块 */
 		iput(inode);
 		if (!(inode = iget(idev,inr))) /* 取到 inr 对应的 inode */
 			return NULL;
@@ -313,21 +519,16 @@ struct m_inode * namei(const char * pathname)
 	const char * basename;
 	int inr,dev,namelen;
 	struct m_inode * dir;
-	struct buffer_head * bh;
-	struct dir_entry * de;
 
 	if (!(dir = dir_namei(pathname,&namelen,&basename)))
 		return NULL;
 	if (!namelen)			/* special case: '/usr/' etc */
 		return dir;
-	bh = find_entry(&dir,basename,namelen,&de);
-	if (!bh) {
+	if (!(inr = lookup(&dir,basename,namelen))) {
 		iput(dir);
 		return NULL;
 	}
-	inr = de->inode;
 	dev = dir->i_dev;
-	brelse(bh);
 	iput(dir);
 	dir=iget(dev,inr);
 	if (dir) {
@@ -373,9 +574,8 @@ int open_namei(const char * pathname, int flag, int mode,
 		return -EISDIR;
 	}
 
-	/* 查找文件名对应的目录项结构，并返回一个缓冲结构  */
-	bh = find_entry(&dir,basename,namelen,&de);
-	if (!bh) { /* 如果没找到 */
+	/* 查找文件名对应的 i 节点号 */
+	if (!(inr = lookup(&dir,basename,namelen))) { /* 如果没找到 */
 		if (!(flag & O_CREAT)) { /* 如果不是创建文件，就放回该目录的 i 节点 */
 			iput(dir); 
 			return -ENOENT;
@@ -406,9 +606,7 @@ int open_namei(const char * pathname, int flag, int mode,
 		*res_inode = inode;
 		return 0;
 	}
-	inr = de->inode;
 	dev = dir->i_dev;
-	brelse(bh);
 	iput(dir);
 	if (flag & O_EXCL)
 		return -EEXIST;
@@ -511,7 +709,7 @@ int sys_mkdir(const char * pathname, int mode)
 	inode->i_size = 32;
 	inode->i_dirt = 1;
 	inode->i_mtime = inode->i_atime = CURRENT_TIME;
-	if (!(inode->i_zone[0]=new_block(inode->i_dev))) {
+	if (!(inode->i_zone[0]=new_block(inode->i_dev,dir->i_zone[0]))) {
 		iput(dir);
 		inode->i_nlinks--;
 		iput(inode);
@@ -579,8 +777,12 @@ static int empty_dir(struct m_inode * inode)
 	nr = 2;
 	de += 2;
 	while (nr<len) {
-		if ((void *) de >= (void *) (bh->b_data+BLOCK_SIZE)) {
-			brelse(bh);
+/* indexed directories have holes: bh is NULL while we are in one */
+		if (!bh || (void *) de >= (void *) (bh->b_data+BLOCK_SIZE)) {
+			if (bh) {
+				brelse(bh);
+				bh = NULL;
+			}
 			block=bmap(inode,nr/DIR_ENTRIES_PER_BLOCK);
 			if (!block) {
 				nr += DIR_ENTRIES_PER_BLOCK;
@@ -597,7 +799,8 @@ static int empty_dir(struct m_inode * inode)
 		de++;
 		nr++;
 	}
-	brelse(bh);
+	if (bh)
+		brelse(bh);
 	return 1;
 }
 
@@ -664,6 +867,8 @@ int sys_rmdir(const char * name)
 	}
 	if (inode->i_nlinks != 2)
 		printk("empty directory has nlink!=2 (%d)",inode->i_nlinks);
+	dcache_remove(dir,de->name,namelen);
+	dcache_remove_dir(inode);
 	de->inode = 0;
 	bh->b_dirt = 1;
 	brelse(bh);
@@ -724,6 +929,7 @@ int sys_unlink(const char * name)
 			inode->i_dev,inode->i_num,inode->i_nlinks);
 		inode->i_nlinks=1;
 	}
+	dcache_remove(dir,de->name,namelen);
 	de->inode = 0;
 	bh->b_dirt = 1;
 	brelse(bh);
@@ -144,44 +144,28 @@ int sys_open(const char * filename,int flag,int mode)
 	/* 对文件模式 mode 进行处理 */
 	mode &= 0777 & ~current->umask;
 
-	/* 扫描空闲项，分配一个文件描述符，没找到就返回错误 */
-	/* struct file * filp[NR_OPEN]; */
-	for(fd=0 ; fd<NR_OPEN ; fd++)
-		if (!current->filp[fd])
-			break;
-	if (fd>=NR_OPEN)
-		return -EINVAL;
-
 	/* 
+		分配最小的空闲文件描述符，见 fs/file_table.c:get_unused_fd()。
 		close_on_exec 是一个进程所有文件句柄的位图标志。每个比特位代表一个打开着的文件描述符，
 		用来确定，在系统调用 execve() 时需要关闭的文件句柄。当程序 fork() 函数创建了一个子进程
 		时，通常会在该子进程中调用 execve() 函数加载执行另一个新程序。此时子进程中开始执行新程序。
 		若一个文件句柄在 close_on_exec 中对应的比特位被置位，那么在执行 execve() 时该对应的文件
-		句柄将被关闭，否则该文件句柄将始终处理打开状态。。
-		unsigned long close_on_exec;
-	 */
-	current->close_on_exec &= ~(1<<fd);
-
-	/* 
-		#define NR_FILE 64
-		fs.h 中 extern struct file file_table[NR_FILE]; 
-		该变量在 file_table.c 中定义 
+		句柄将被关闭，否则该文件句柄将始终处理打开状态。get_unused_fd() 会清除该比特位。
 	 */
-	f=0+file_table;
+	if ((fd=get_unused_fd(0))<0)
+		return fd;
 
-	/* 扫描 f->f_count == 0 的空闲项，即引用计数为 0 的项 */
-	for (i=0 ; i<NR_FILE ; i++,f++)
-		if (!f->f_count) break;
-	if (i>=NR_FILE)
-		return -EINVAL;
-
-	/* 引用计数加 1 */
-	(current->filp[fd]=f)->f_count++;
+	/* 从空闲链表取一个文件结构，引用计数为 1 */
+	if (!(f=get_empty_filp())) {
+		put_unused_fd(fd);
+		return -ENFILE;
+	}
+	current->filp[fd]=f;
 
 	/* 计算 inode 节点 */
 	if ((i=open_namei(filename,flag,mode,&inode))<0) {
-		current->filp[fd]=NULL;
-		f->f_count=0;
+		put_unused_fd(fd);
+		put_filp(f);
 		return i;
 	}
 /* ttys are somewhat special (ttyxx major==4, tty major==5) */
@@ -194,8 +178,8 @@ int sys_open(const char * filename,int flag,int mode)
 		} else if (MAJOR(inode->i_zone[0])==5)
 			if (current->tty<0) {
 				iput(inode);
-				current->filp[fd]=NULL;
-				f->f_count=0;
+				put_unused_fd(fd);
+				put_filp(f);
 				return -EPERM;
 			}
 	}
@@ -207,6 +191,7 @@ int sys_open(const char * filename,int flag,int mode)
 	f->f_count = 1;
 	f->f_inode = inode;
 	f->f_pos = 0;
+	f->f_ranext = f->f_rawin = f->f_raend = 0;
 	return (fd);
 }
 
@@ -219,16 +204,14 @@ int sys_close(unsigned int fd)
 {	
 	struct file * filp;
 
-	if (fd >= NR_OPEN)
-		return -EINVAL;
-	current->close_on_exec &= ~(1<<fd);
-	if (!(filp = current->filp[fd]))
+	if (fd >= current->max_fds || !(filp = current->filp[fd]))
 		return -EINVAL;
-	current->filp[fd] = NULL;
+	put_unused_fd(fd);
 	if (filp->f_count == 0)
 		panic("Close: file count is 0");
 	if (--filp->f_count)
 		return (0);
 	iput(filp->f_inode);
+	put_filp(filp);
 	return (0);
 }
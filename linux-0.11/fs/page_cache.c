@@ -0,0 +1,202 @@
+/*
+ *  linux/fs/page_cache.c
+ */
+
+/*
+ * page_cache.c keeps whole pages of file data around, so that a program
+ * faulting in its text doesn't have to read 4 buffers and copy them into
+ * a new page every time, and so that read() can copy a page at a time.
+ *
+ * A page is named by the device, the inode number and the file block it
+ * starts at, and holds the 4 blocks from there on. Note that this means
+ * read() (pages start at block 0,4,8...) and demand-loading (pages start
+ * at block 1,5,9... as the first block of the executable is its header)
+ * use different pages for the same file. Nothing else would work without
+ * copying: the pager has to map whole pages.
+ *
+ * The cache holds one reference (in mem_map) to each of its pages. The
+ * pager maps them read-only, so writing to one gets the task a private
+ * copy through the normal copy-on-write path. A page that only the cache
+ * uses can be given back at any time, which get_free_page() does when
+ * it runs out of memory.
+ */
+
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/system.h>
+
+#define NR_CACHE_PAGES	256
+#define NR_PAGE_HASH	61
+
+static struct cache_page {
+	unsigned long page;		/* physical address, 0 = unused */
+	unsigned short dev;
+	unsigned short ino;
+	unsigned long block;		/* first file block in the page */
+	unsigned char referenced;	/* used since the clock hand passed */
+	struct cache_page * next;	/* hash chain */
+} cache_pages[NR_CACHE_PAGES];
+
+static struct cache_page * page_hash[NR_PAGE_HASH];
+static struct cache_page * clock_hand = cache_pages;
+/* bumped by every invalidation, see get_cache_page() */
+static unsigned long cache_generation = 0;
+
+#define _pagehashfn(dev,ino,block) (((unsigned)((dev)^(ino)^(block)))%NR_PAGE_HASH)
+#define page_hash(dev,ino,block) page_hash[_pagehashfn(dev,ino,block)]
+
+static struct cache_page * find_cache_page(int dev, int ino, int block)
+{
+	struct cache_page * p;
+
+	for (p = page_hash(dev,ino,block) ; p ; p = p->next)
+		if (p->dev == dev && p->ino == ino && p->block == block)
+			return p;
+	return NULL;
+}
+
+/*
+ * remove_cache_page() takes a page out of the cache and drops the cache's
+ * reference to it. Tasks that have it mapped keep their own.
+ */
+static void remove_cache_page(struct cache_page * p)
+{
+	struct cache_page ** pp;
+
+	for (pp = &page_hash(p->dev,p->ino,p->block) ; *pp ; pp = &(*pp)->next)
+		if (*pp == p) {
+			*pp = p->next;
+			break;
+		}
+	free_page(p->page);
+	p->page = 0;
+	p->next = NULL;
+}
+
+/*
+ * get_unused_entry() returns a free slot, evicting a page that nobody but
+ * the cache uses if need be. It's a clock: pages used since the hand last
+ * passed get a second chance. Returns NULL if every page is mapped.
+ */
+static struct cache_page * get_unused_entry(void)
+{
+	int i;
+
+	for (i = 2*NR_CACHE_PAGES ; i-- > 0 ; ) {
+		struct cache_page * p = clock_hand;
+
+		if (++clock_hand >= cache_pages + NR_CACHE_PAGES)
+			clock_hand = cache_pages;
+		if (!p->page)
+			return p;
+		if (page_count(p->page) != 1)
+			continue;
+		if (p->referenced) {
+			p->referenced = 0;
+			continue;
+		}
+		remove_cache_page(p);
+		return p;
+	}
+	return NULL;
+}
+
+/*
+ * get_cache_page() returns the physical address of a page holding file
+ * blocks block..block+3 of the inode, with a reference for the caller:
+ * it has to free_page() it, or map it. Returns 0 if there is no memory,
+ * or if a block couldn't be read: callers go through the buffer cache
+ * then, which reports the error.
+ */
+unsigned long get_cache_page(struct m_inode * inode, int block)
+{
+	struct cache_page * p;
+	unsigned long page, generation;
+	int nr[4];
+	int i;
+
+	if ((p = find_cache_page(inode->i_dev,inode->i_num,block))) {
+		p->referenced = 1;
+		page_ref(p->page);
+		return p->page;
+	}
+	if (!(page = get_free_page()))
+		return 0;
+	generation = cache_generation;
+	for (i=0 ; i<4 ; i++)
+		nr[i] = bmap(inode,block+i);
+	if (!bread_page(page,inode->i_dev,nr)) {
+		free_page(page);
+		return 0;
+	}
+/* somebody else might have loaded the same page while we slept */
+	if ((p = find_cache_page(inode->i_dev,inode->i_num,block))) {
+		free_page(page);
+		p->referenced = 1;
+		page_ref(p->page);
+		return p->page;
+	}
+/* ... or written to the file: then our copy is only good for this once */
+	if (generation != cache_generation || !(p = get_unused_entry()))
+		return page;
+	p->page = page;
+	p->dev = inode->i_dev;
+	p->ino = inode->i_num;
+	p->block = block;
+	p->referenced = 1;
+	p->next = page_hash(p->dev,p->ino,p->block);
+	page_hash(p->dev,p->ino,p->block) = p;
+	page_ref(page);
+	return page;
+}
+
+/*
+ * invalidate_cache_pages() throws out the pages of an inode that contain
+ * the given block, or all of them if block is negative. file_write() and
+ * truncate() call it, so the cache never holds stale data.
+ */
+void invalidate_cache_pages(struct m_inode * inode, int block)
+{
+	struct cache_page * p;
+	int i;
+
+	cache_generation++;
+	if (block >= 0) {
+		for (i = 0 ; i < 4 && i <= block ; i++)
+			if ((p = find_cache_page(inode->i_dev,inode->i_num,block-i)))
+				remove_cache_page(p);
+		return;
+	}
+	for (p = cache_pages ; p < cache_pages + NR_CACHE_PAGES ; p++)
+		if (p->page && p->dev == inode->i_dev && p->ino == inode->i_num)
+			remove_cache_page(p);
+}
+
+void invalidate_cache_dev(int dev)
+{
+	struct cache_page * p;
+
+	cache_generation++;
+	for (p = cache_pages ; p < cache_pages + NR_CACHE_PAGES ; p++)
+		if (p->page && p->dev == dev)
+			remove_cache_page(p);
+}
+
+/*
+ * shrink_page_cache() gives one page back to the free pool, if there is
+ * one that only the cache uses. Returns 1 if it freed a page.
+ */
+int shrink_page_cache(void)
+{
+	struct cache_page * p;
+
+	for (p = cache_pages ; p < cache_pages + NR_CACHE_PAGES ; p++)
+		if (p->page && page_count(p->page) == 1) {
+			remove_cache_page(p);
+			return 1;
+		}
+	return 0;
+}
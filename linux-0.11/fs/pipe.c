@@ -73,39 +73,37 @@ int sys_pipe(unsigned long * fildes)
 	struct m_inode * inode;
 	struct file * f[2];
 	int fd[2];
-	int i,j;
 
-	j=0;
-	for(i=0;j<2 && i<NR_FILE;i++)
-		if (!file_table[i].f_count)
-			(f[j++]=i+file_table)->f_count++;
-	if (j==1)
-		f[0]->f_count=0;
-	if (j<2)
+	if (!(f[0]=get_empty_filp()))
 		return -1;
-	j=0;
-	for(i=0;j<2 && i<NR_OPEN;i++)
-		if (!current->filp[i]) {
-			current->filp[ fd[j]=i ] = f[j];
-			j++;
-		}
-	if (j==1)
-		current->filp[fd[0]]=NULL;
-	if (j<2) {
-		f[0]->f_count=f[1]->f_count=0;
+	if (!(f[1]=get_empty_filp())) {
+		put_filp(f[0]);
 		return -1;
 	}
+	if ((fd[0]=get_unused_fd(0))<0)
+		goto no_fds;
+	if ((fd[1]=get_unused_fd(0))<0) {
+		put_unused_fd(fd[0]);
+		goto no_fds;
+	}
 	if (!(inode=get_pipe_inode())) {
-		current->filp[fd[0]] =
-			current->filp[fd[1]] = NULL;
-		f[0]->f_count = f[1]->f_count = 0;
-		return -1;
+		put_unused_fd(fd[0]);
+		put_unused_fd(fd[1]);
+		goto no_fds;
 	}
+	current->filp[fd[0]] = f[0];
+	current->filp[fd[1]] = f[1];
 	f[0]->f_inode = f[1]->f_inode = inode;
 	f[0]->f_pos = f[1]->f_pos = 0;
+	f[0]->f_ranext = f[0]->f_rawin = f[0]->f_raend = 0;
+	f[1]->f_ranext = f[1]->f_rawin = f[1]->f_raend = 0;
 	f[0]->f_mode = 1;		/* read */
 	f[1]->f_mode = 2;		/* write */
 	put_fs_long(fd[0],0+fildes);
 	put_fs_long(fd[1],1+fildes);
 	return 0;
+no_fds:
+	put_filp(f[0]);
+	put_filp(f[1]);
+	return -1;
 }
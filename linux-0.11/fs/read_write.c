@@ -27,7 +27,7 @@ int sys_lseek(unsigned int fd,off_t offset, int origin)
 	struct file * file;
 	int tmp;
 
-	if (fd >= NR_OPEN || !(file=current->filp[fd]) || !(file->f_inode)
+	if (fd >= current->max_fds || !(file=current->filp[fd]) || !(file->f_inode)
 	   || !IS_SEEKABLE(MAJOR(file->f_inode->i_dev)))
 		return -EBADF;
 	if (file->f_inode->i_pipe)
@@ -57,7 +57,7 @@ int sys_read(unsigned int fd,char * buf,int count)
 	struct file * file;
 	struct m_inode * inode;
 
-	if (fd>=NR_OPEN || count<0 || !(file=current->filp[fd]))
+	if (fd>=current->max_fds || count<0 || !(file=current->filp[fd]))
 		return -EINVAL;
 	if (!count)
 		return 0;
@@ -85,7 +85,7 @@ int sys_write(unsigned int fd,char * buf,int count)
 	struct file * file;
 	struct m_inode * inode;
 	
-	if (fd>=NR_OPEN || count <0 || !(file=current->filp[fd]))
+	if (fd>=current->max_fds || count <0 || !(file=current->filp[fd]))
 		return -EINVAL;
 	if (!count)
 		return 0;
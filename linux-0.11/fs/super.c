@@ -119,6 +119,7 @@ static struct super_block * read_super(int dev)
 	s->s_imount = NULL;
 	s->s_time = 0;
 	s->s_rd_only = 0;
+	s->s_dirindex = 0;
 	s->s_dirt = 0;
 	lock_super(s);
 	if (!(bh = bread(dev,1))) {
@@ -184,9 +185,8 @@ int sys_umount(char * dev_name)
 		return -ENOENT;
 	if (!sb->s_imount->i_mount)
 		printk("Mounted inode has i_mount=0\n");
-	for (inode=inode_table+0 ; inode<inode_table+NR_INODE ; inode++)
-		if (inode->i_dev==dev && inode->i_count)
-				return -EBUSY;
+	if (inodes_busy(dev))
+		return -EBUSY;
 	sb->s_imount->i_mount=0;
 	iput(sb->s_imount);
 	sb->s_imount = NULL;
@@ -194,6 +194,8 @@ int sys_umount(char * dev_name)
 	sb->s_isup = NULL;
 	put_super(dev);
 	sync_dev(dev);
+	invalidate_cache_dev(dev);
+	dcache_invalidate_dev(dev);
 	return 0;
 }
 
@@ -233,6 +235,7 @@ int sys_mount(char * dev_name, char * dir_name, int rw_flag)
 		iput(dir_i);
 		return -EPERM;
 	}
+	sb->s_dirindex = (rw_flag & MS_DIRINDEX) != 0;
 	sb->s_imount=dir_i;
 	dir_i->i_mount=1;
 	dir_i->i_dirt=1;		/* NOTE! we don't iput(dir_i) */
@@ -247,8 +250,6 @@ void mount_root(void)
 
 	if (32 != sizeof (struct d_inode))
 		panic("bad i-node size");
-	for(i=0;i<NR_FILE;i++)
-		file_table[i].f_count=0;
 	if (MAJOR(ROOT_DEV) == 2) {
 		printk("Insert root floppy and press ENTER");
 		wait_for_keypress();
@@ -50,6 +50,8 @@ void truncate(struct m_inode * inode)
 
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
 		return;
+	invalidate_cache_pages(inode,-1);
+	discard_prealloc(inode);
 	for (i=0;i<7;i++)
 		if (inode->i_zone[i]) {
 			free_block(inode->i_dev,inode->i_zone[i]);
@@ -18,6 +18,45 @@
 /*#define KBD_FR */
 /*#define KBD_FINNISH */
 
+/*
+ * The I/O scheduler each block major starts with: ELV_ELEVATOR,
+ * ELV_CSCAN or ELV_DEADLINE (see <linux/fs.h>). The BLKELVSET ioctl
+ * changes it later.
+ */
+#define RD_ELEVATOR ELV_ELEVATOR
+#define FD_ELEVATOR ELV_ELEVATOR
+#define HD_ELEVATOR ELV_DEADLINE
+
+/*
+ * The largest request (in sectors) the harddisk gets: make_request()
+ * merges requests for adjacent blocks up to this size. At most 254,
+ * 2 means no merging.
+ */
+#define HD_MAX_SECTORS 128
+
+/*
+ * Sectors per interrupt the harddisk driver asks the drives for, with
+ * SET MULTIPLE MODE (a power of two; 0 or 1 is one sector at a time).
+ * Drives that can do less get what they can.
+ */
+#define HD_MULT_COUNT 16
+
+/*
+ * Define HD_DMA to let the harddisk driver use bus-master DMA if it finds
+ * a PCI IDE controller (PIIX) and the drive says it can. It falls back
+ * to PIO by itself if DMA doesn't work.
+ */
+#define HD_DMA
+
+/*
+ * The null block device (major 9, see kernel/blk_drv/nullblk.c): the
+ * size of each minor in blocks, the largest request it gets, and the
+ * jiffies (at least 1) minor 1 takes per request.
+ */
+#define NULLBLK_BLOCKS 4096
+#define NULLBLK_MAX_SECTORS 128
+#define NULLBLK_DELAY 1
+
 /*
  * Normally, Linux can get the drive parameters from the BIOS at
  * startup, but if this for some unfathomable reason fails, you'd
@@ -28,6 +28,15 @@
 #define READA 2		/* read-ahead - don't pause */
 #define WRITEA 3	/* "write-ahead" - silly, but somewhat useful */
 
+/* block device ioctls: get and set the I/O scheduler of the major */
+#define BLKELVGET 0x1201
+#define BLKELVSET 0x1202
+
+#define ELV_ELEVATOR	0	/* the old one: reads first, one sorted list */
+#define ELV_CSCAN	1	/* one-way sweeps */
+#define ELV_DEADLINE	2	/* C-SCAN, but expired requests go first */
+#define NR_ELEVATORS	3
+
 void buffer_init(long buffer_end);
 
 #define MAJOR(a) (((unsigned)(a))>>8)
@@ -40,11 +49,15 @@ void buffer_init(long buffer_end);
 #define Z_MAP_SLOTS 8
 #define SUPER_MAGIC 0x137F
 
-#define NR_OPEN 20
+#define NR_OPEN 1024		/* a page of struct file pointers */
+#define NR_OPEN_DEFAULT 32	/* fds kept in the task_struct itself */
 #define NR_INODE 32
 #define NR_FILE 64
 #define NR_SUPER 8
-#define NR_HASH 307
+
+/* mount() flag: index directories that outgrow a block, see namei.c */
+#define MS_DIRINDEX 2
+
 #define NR_BUFFERS nr_buffers
 #define BLOCK_SIZE 1024
 #define BLOCK_SIZE_BITS 10
@@ -65,6 +78,16 @@ __asm__("incl %0\n\tandl $4095,%0"::"m" (head))
 
 typedef char buffer_block[BLOCK_SIZE];
 
+/*
+ * The buffers are kept on one of these lru-lists, ordered the same way
+ * the old BADNESS() did: a clean buffer is the cheapest to reuse, a
+ * locked one only has to be waited on, and a dirty one must be written.
+ */
+#define BUF_CLEAN	0
+#define BUF_LOCKED	1
+#define BUF_DIRTY	2
+#define NR_LIST		3
+
 struct buffer_head {
 	char * b_data;			/* pointer to data block (1024 bytes) */
 	unsigned long b_blocknr;	/* block number */
@@ -73,11 +96,15 @@ struct buffer_head {
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
 	unsigned char b_count;		/* users using this block */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
+	unsigned char b_list;		/* lru list the buffer is on */
+	unsigned char b_reada;		/* read ahead, not asked for yet */
+	unsigned long b_flushtime;	/* when a dirty buffer should be written */
 	struct task_struct * b_wait;
 	struct buffer_head * b_prev;
 	struct buffer_head * b_next;
 	struct buffer_head * b_prev_free;
 	struct buffer_head * b_next_free;
+	struct buffer_head * b_reqnext;	/* next buffer of the same request */
 };
 
 struct d_inode {
@@ -121,6 +148,11 @@ struct m_inode {
 	unsigned char i_mount;
 	unsigned char i_seek;
 	unsigned char i_update;
+	unsigned short i_prealloc_block;	/* next zone of the reserved run */
+	unsigned short i_prealloc_count;	/* zones left in it */
+	struct m_inode * i_next;		/* hash chain */
+	struct m_inode * i_next_free;		/* lru list of unused inodes */
+	struct m_inode * i_prev_free;
 };
 
 struct file {
@@ -128,7 +160,12 @@ struct file {
 	unsigned short f_flags;
 	unsigned short f_count;
 	struct m_inode * f_inode;
+	struct file * f_next;	/* free list */
 	off_t f_pos;
+/* readahead state for file_read(), in file blocks */
+	int f_ranext;		/* block a sequential reader reads next */
+	int f_rawin;		/* readahead window, 0 for random access */
+	int f_raend;		/* readahead started up to (not incl.) here */
 };
 
 struct super_block {
@@ -151,6 +188,7 @@ struct super_block {
 	unsigned char s_lock;
 	unsigned char s_rd_only;
 	unsigned char s_dirt;
+	unsigned char s_dirindex;	/* mounted with MS_DIRINDEX */
 };
 
 struct d_super_block {
@@ -171,6 +209,10 @@ struct dir_entry {
 
 extern struct m_inode inode_table[NR_INODE];
 extern struct file file_table[NR_FILE];
+extern struct file * get_empty_filp(void);
+extern void put_filp(struct file * f);
+extern int get_unused_fd(unsigned int start);
+extern void put_unused_fd(int fd);
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head * start_buffer;
 extern int nr_buffers;
@@ -192,15 +234,36 @@ extern void iput(struct m_inode * inode);
 extern struct m_inode * iget(int dev,int nr);
 extern struct m_inode * get_empty_inode(void);
 extern struct m_inode * get_pipe_inode(void);
+extern void insert_inode_hash(struct m_inode * inode);
+extern void clear_inode(struct m_inode * inode);
+extern int inodes_busy(int dev);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
 extern void brelse(struct buffer_head * buf);
+extern void refile_buffer(struct buffer_head * bh);
+extern void show_buffers(void);
+extern void hash_chain_stat(int * used, int * total, int * max);
 extern struct buffer_head * bread(int dev,int block);
-extern void bread_page(unsigned long addr,int dev,int b[4]);
+extern int bread_page(unsigned long addr,int dev,int b[4]);
 extern struct buffer_head * breada(int dev,int block,...);
-extern int new_block(int dev);
+extern void read_ahead(int dev,int block);
+extern unsigned long get_cache_page(struct m_inode * inode, int block);
+extern void invalidate_cache_pages(struct m_inode * inode, int block);
+extern void invalidate_cache_dev(int dev);
+extern int shrink_page_cache(void);
+extern unsigned long dcache_generation;
+extern int dcache_lookup(struct m_inode * dir, const char * name, int len);
+extern void dcache_add(struct m_inode * dir, const char * name, int len,
+	int inr, unsigned long generation);
+extern void dcache_remove(struct m_inode * dir, const char * name, int len);
+extern void dcache_remove_dir(struct m_inode * dir);
+extern void dcache_invalidate_dev(int dev);
+extern int shrink_buffers(void);
+extern int new_block(int dev, int goal);
 extern void free_block(int dev, int block);
+extern int new_file_block(struct m_inode * inode, int goal);
+extern void discard_prealloc(struct m_inode * inode);
 extern struct m_inode * new_inode(int dev);
 extern void free_inode(struct m_inode * inode);
 extern int sync_dev(int dev);
@@ -20,6 +20,18 @@
 
 #define HD_CMD		0x3f6
 
+/* Bus-master IDE registers (PIIX and compatibles), from the base in BAR4 */
+#define BM_COMMAND	0	/* bit 0: start, bit 3: read (to memory) */
+#define BM_STATUS	2	/* see bits below, 1 and 2 cleared by writing 1 */
+#define BM_PRD		4	/* physical address of the PRD table */
+
+#define BM_CMD_START	0x01
+#define BM_CMD_READ	0x08
+#define BM_STAT_ACTIVE	0x01
+#define BM_STAT_ERR	0x02
+#define BM_STAT_INTR	0x04
+#define BM_PRD_EOT	0x80000000	/* last entry of the PRD table */
+
 /* Bits of HD_STATUS */
 #define ERR_STAT	0x01
 #define INDEX_STAT	0x02
@@ -40,6 +52,12 @@
 #define WIN_SEEK 		0x70
 #define WIN_DIAGNOSE		0x90
 #define WIN_SPECIFY		0x91
+#define WIN_MULTREAD		0xC4	/* read sectors using multiple mode */
+#define WIN_MULTWRITE		0xC5	/* write sectors using multiple mode */
+#define WIN_SETMULT		0xC6	/* enable/disable multiple mode */
+#define WIN_READDMA		0xC8	/* read sectors using DMA */
+#define WIN_WRITEDMA		0xCA	/* write sectors using DMA */
+#define WIN_IDENTIFY		0xEC	/* ask drive to identify itself */
 
 /* Bits for HD_ERROR */
 #define MARK_ERR	0x01	/* Bad address mark ? */
@@ -6,5 +6,9 @@
 extern unsigned long get_free_page(void);
 extern unsigned long put_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
+extern void page_ref(unsigned long addr);
+extern int page_count(unsigned long addr);
+extern int nr_free_pages;
+extern unsigned long ioremap(unsigned long phys);
 
 #endif
@@ -0,0 +1,44 @@
+#ifndef _PCI_H
+#define _PCI_H
+
+/*
+ * PCI configuration space, see kernel/pci.c. A device is named by its
+ * bus number and devfn (slot<<3 | function).
+ */
+
+#define PCI_VENDOR_ID		0x00	/* 16 bits */
+#define PCI_DEVICE_ID		0x02	/* 16 bits */
+#define PCI_COMMAND		0x04	/* 16 bits */
+#define  PCI_COMMAND_IO		0x1	/* enable response in I/O space */
+#define  PCI_COMMAND_MEMORY	0x2	/* enable response in memory space */
+#define  PCI_COMMAND_MASTER	0x4	/* enable bus mastering */
+#define PCI_STATUS		0x06	/* 16 bits */
+#define PCI_CLASS_PROG		0x09	/* programming interface */
+#define PCI_CLASS_DEVICE	0x0a	/* base class << 8 | sub class */
+#define PCI_HEADER_TYPE		0x0e	/* bit 7: multi-function device */
+#define PCI_BASE_ADDRESS_0	0x10	/* 32 bits, up to 6 of them */
+#define  PCI_BASE_ADDRESS_SPACE_IO	0x01
+#define  PCI_BASE_ADDRESS_IO_MASK	(~0x03UL)
+#define  PCI_BASE_ADDRESS_MEM_MASK	(~0x0fUL)
+#define PCI_SUBSYSTEM_ID	0x2e	/* 16 bits */
+#define PCI_INTERRUPT_LINE	0x3c	/* 8 bits */
+
+#define PCI_CLASS_STORAGE_IDE	0x0101
+#define PCI_CLASS_STORAGE_SATA	0x0106
+
+#define PCI_VENDOR_ID_INTEL	0x8086
+
+extern int pci_present(void);
+extern unsigned long pci_read_config_dword(int bus, int devfn, int where);
+extern unsigned short pci_read_config_word(int bus, int devfn, int where);
+extern unsigned char pci_read_config_byte(int bus, int devfn, int where);
+extern void pci_write_config_dword(int bus, int devfn, int where,
+	unsigned long val);
+extern void pci_write_config_word(int bus, int devfn, int where,
+	unsigned short val);
+extern int pci_find_device(int vendor, int device, int index,
+	int * bus, int * devfn);
+extern int pci_find_class(int class, int index, int * bus, int * devfn);
+extern int pci_request_irq(int irq, void (*handler)(void));
+
+#endif
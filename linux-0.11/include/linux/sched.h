@@ -12,10 +12,16 @@
 #include <linux/mm.h>
 #include <signal.h>
 
-#if (NR_OPEN > 32)
-#error "Currently the close-on-exec-flags are in one word, max 32 files/proc"
+#if (NR_OPEN*4 != PAGE_SIZE)
+#error "A grown filp[] is one page of NR_OPEN pointers"
 #endif
 
+/* open_fds and close_on_exec are bitmaps of NR_OPEN bits */
+#define FD_WORDS (NR_OPEN/32)
+#define fd_bit(fd,map) (((map)[(fd)>>5]>>((fd)&31))&1)
+#define set_fd_bit(fd,map) ((map)[(fd)>>5] |= 1UL<<((fd)&31))
+#define clear_fd_bit(fd,map) ((map)[(fd)>>5] &= ~(1UL<<((fd)&31)))
+
 #define TASK_RUNNING		0
 #define TASK_INTERRUPTIBLE	1
 #define TASK_UNINTERRUPTIBLE	2
@@ -100,9 +106,12 @@ struct task_struct {
 	struct m_inode * pwd;
 	struct m_inode * root;
 	struct m_inode * executable;
-	unsigned long close_on_exec;
+	unsigned long close_on_exec[FD_WORDS];
+	unsigned long open_fds[FD_WORDS];	/* fds in use, see get_unused_fd() */
+	int max_fds;				/* size of filp[] */
 	// 数组索引号就是文件描述符。请参考 fs/open.c:sys_open
-	struct file * filp[NR_OPEN];
+	struct file ** filp;			/* fd_array, or a page when grown */
+	struct file * fd_array[NR_OPEN_DEFAULT];
 /* ldt for this task 0 - zero 1 - cs 2 - ds&ss */
 	struct desc_struct ldt[3];
 /* tss for this task */
@@ -121,8 +130,8 @@ struct task_struct {
 /* uid etc */	0,0,0,0,0,0, \
 /* alarm */	0,0,0,0,0,0, \
 /* math */	0, \
-/* fs info */	-1,0022,NULL,NULL,NULL,0, \
-/* filp */	{NULL,}, \
+/* fs info */	-1,0022,NULL,NULL,NULL,{0,},{0,}, \
+/* filp */	NR_OPEN_DEFAULT,init_task.task.fd_array,{NULL,}, \
 	{ \
 		{0,0}, \
 /* ldt */	{0x9f,0xc0fa00}, \
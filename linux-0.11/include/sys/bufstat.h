@@ -0,0 +1,23 @@
+#ifndef _BUFSTAT_H
+#define _BUFSTAT_H
+
+/*
+ * Buffer cache statistics, kept per device. bufstat(nr,bs) copies slot
+ * nr (0 <= nr < NR_BUFSTAT) to bs, a slot with bs_dev 0 being unused.
+ * bufstat(-1,NULL) clears them all.
+ */
+#define NR_BUFSTAT 16
+
+struct buffer_stat {
+	unsigned short bs_dev;
+	unsigned long bs_lookups;	/* getblk() calls */
+	unsigned long bs_hits;		/* ... that found the block cached */
+	unsigned long bs_misses;	/* ... that had to take a new buffer */
+	unsigned long bs_rahits;	/* hits on blocks that were read ahead */
+	unsigned long bs_dirty_evict;	/* dirty victims getblk() wrote out */
+	unsigned long bs_sync_writes;	/* blocks written by sync/sync_dev */
+};
+
+extern int bufstat(int nr, struct buffer_stat * bs);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _INODESTAT_H
+#define _INODESTAT_H
+
+/*
+ * In-core inode cache statistics. inodestat(is) copies them to is,
+ * inodestat(NULL) clears the counters.
+ */
+struct inode_stat {
+	unsigned long is_inodes;	/* in-core inodes there are */
+	unsigned long is_used;		/* ... that are in use */
+	unsigned long is_pages;		/* pages the cache grew by */
+	unsigned long is_lookups;	/* iget() calls */
+	unsigned long is_hits;		/* ... that found the inode in core */
+};
+
+extern int inodestat(struct inode_stat * is);
+
+#endif
@@ -53,6 +53,8 @@
 #include <sys/stat.h>
 #include <sys/times.h>
 #include <sys/utsname.h>
+#include <sys/bufstat.h>
+#include <sys/inodestat.h>
 #include <utime.h>
 
 #ifdef __LIBRARY__
@@ -129,6 +131,9 @@
 #define __NR_ssetmask	69
 #define __NR_setreuid	70
 #define __NR_setregid	71
+#define __NR_bdflush	72
+#define __NR_bufstat	73
+#define __NR_inodestat	74
 
 #define _syscall0(type,name) \
 type name(void) \
@@ -233,6 +238,7 @@ int stat(const char * filename, struct stat * stat_buf);
 int fstat(int fildes, struct stat * stat_buf);
 int stime(time_t * tptr);
 int sync(void);
+int bdflush(int func, long data);
 time_t time(time_t * tloc);
 time_t times(struct tms * tbuf);
 int ulimit(int cmd, long limit);
@@ -24,6 +24,7 @@ static inline _syscall0(int,fork)
 static inline _syscall0(int,pause)
 static inline _syscall1(int,setup,void *,BIOS)
 static inline _syscall0(int,sync)
+static inline _syscall2(int,bdflush,int,func,long,data)
 
 #include <linux/tty.h>
 #include <linux/sched.h>
@@ -47,6 +48,9 @@ extern void blk_dev_init(void);
 extern void chr_dev_init(void);
 extern void hd_init(void);
 extern void floppy_init(void);
+extern void ahci_init(void);
+extern void virtio_blk_init(void);
+extern void nullblk_init(void);
 extern void mem_init(long start, long end);
 extern long rd_init(long mem_start, int length);
 extern long kernel_mktime(struct tm * tm);
@@ -217,6 +221,21 @@ void main(void)		/* This really IS void, no error here. */
 	 */
 	floppy_init();
 
+	/*
+	 * AHCI SATA 磁盘初始化 kernel/blk_drv/ahci.c
+	 */
+	ahci_init();
+
+	/*
+	 * virtio 块设备初始化 kernel/blk_drv/virtio_blk.c
+	 */
+	virtio_blk_init();
+
+	/*
+	 * 空块设备初始化, 用于测量块设备层开销 kernel/blk_drv/nullblk.c
+	 */
+	nullblk_init();
+
 	/*
 	 * 所有初始化完毕，开中断
 	 */
@@ -302,6 +321,11 @@ void init(void)
 	printf("%d buffers = %d bytes buffer space\n\r",NR_BUFFERS,
 		NR_BUFFERS*BLOCK_SIZE);
 	printf("Free mem: %d bytes\n\r",memory_end-main_memory_start);
+	if (!fork()) {
+		close(0);close(1);close(2);
+		setsid();
+		_exit(bdflush(0,0));
+	}
 	if (!(pid=fork())) {
 		close(0);
 		if (open("/etc/rc",O_RDONLY,0))
@@ -0,0 +1,443 @@
+/*
+ *  linux/kernel/blk_drv/ahci.c
+ */
+
+/*
+ * ahci.c drives SATA disks on an AHCI controller (like QEMU's ich9-ahci).
+ * Unlike hd.c it doesn't do one request at a time: do_ahci_request()
+ * takes requests off the list as long as the disk has a free command
+ * slot, so with NCQ up to 32 of them are in flight, and the disk does
+ * them in the order it likes. The interrupt finds out which slots are
+ * done, ends their requests and issues new ones.
+ *
+ * Each disk found is one minor (0,1,...), there are no partitions.
+ */
+
+#include <string.h>
+
+#include <linux/config.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/pci.h>
+#include <asm/system.h>
+
+#define MAJOR_NR 7
+#include "blk.h"
+
+#define AHCI_MAX_DISKS	4
+#define AHCI_MAX_PORTS	30	/* the ports in the first page of the HBA */
+#define AHCI_NR_PRD	32
+#define AHCI_MAX_SECTORS (2*AHCI_NR_PRD)
+
+/* HBA registers */
+#define HBA_CAP		0x00
+#define  CAP_SNCQ	(1UL<<30)
+#define HBA_GHC		0x04
+#define  GHC_IE		(1UL<<1)
+#define  GHC_AE		(1UL<<31)
+#define HBA_IS		0x08
+#define HBA_PI		0x0c
+
+/* port registers, at 0x100 + port*0x80 */
+#define PX_CLB		0x00
+#define PX_CLBU		0x04
+#define PX_FB		0x08
+#define PX_FBU		0x0c
+#define PX_IS		0x10
+#define PX_IE		0x14
+#define PX_CMD		0x18
+#define  CMD_ST		(1UL<<0)
+#define  CMD_FRE	(1UL<<4)
+#define  CMD_FR		(1UL<<14)
+#define  CMD_CR		(1UL<<15)
+#define PX_TFD		0x20
+#define PX_SIG		0x24
+#define PX_SSTS		0x28
+#define PX_SERR		0x30
+#define PX_SACT		0x34
+#define PX_CI		0x38
+
+/* PX_IS and PX_IE bits */
+#define IS_DHRS		(1UL<<0)	/* register FIS: command done */
+#define IS_PSS		(1UL<<1)	/* PIO setup FIS */
+#define IS_SDBS		(1UL<<3)	/* set device bits FIS: NCQ done */
+#define IS_IFS		(1UL<<27)
+#define IS_HBDS		(1UL<<28)
+#define IS_HBFS		(1UL<<29)
+#define IS_TFES		(1UL<<30)	/* task file error */
+#define IS_ERROR	(IS_IFS|IS_HBDS|IS_HBFS|IS_TFES)
+
+#define SIG_ATA		0x00000101
+#define TFD_BSY		0x80
+#define TFD_DRQ		0x08
+#define TFD_ERR		0x01
+
+#define ATA_IDENTIFY		0xEC
+#define ATA_READ_DMA		0xC8
+#define ATA_WRITE_DMA		0xCA
+#define ATA_READ_DMA_EXT	0x25
+#define ATA_WRITE_DMA_EXT	0x35
+#define ATA_READ_FPDMA		0x60
+#define ATA_WRITE_FPDMA		0x61
+
+struct ahci_cmd_hdr {
+	unsigned short flags;		/* FIS length in dwords, bit 6: write */
+	unsigned short prdtl;		/* nr of PRD entries */
+	unsigned long prdbc;		/* bytes transferred */
+	unsigned long ctba;		/* command table address */
+	unsigned long ctbau;
+	unsigned long reserved[4];
+};
+
+struct ahci_prd {
+	unsigned long dba;		/* data address */
+	unsigned long dbau;
+	unsigned long reserved;
+	unsigned long dbc;		/* byte count - 1 */
+};
+
+struct ahci_cmd_table {
+	unsigned char cfis[64];
+	unsigned char acmd[16];
+	unsigned char reserved[48];
+	struct ahci_prd prd[AHCI_NR_PRD];
+};
+
+/* command tables are 128-byte aligned: round them up to 1kB, 4 a page */
+#define TABLE_SIZE	1024
+#define TABLES_PER_PAGE	(4096/TABLE_SIZE)
+
+static struct ahci_disk {
+	int port;
+	unsigned long base;		/* port registers */
+	struct ahci_cmd_hdr * cmd_list;
+	struct ahci_cmd_table * table[32];
+	struct request * slot[32];
+	unsigned long issued;		/* slots in use */
+	unsigned long nr_sects;
+	int depth;			/* slots we use, 1 without NCQ */
+	int lba48;
+} ahci_disk[AHCI_MAX_DISKS];
+
+static int nr_disks = 0;
+static unsigned long hba_base = 0;
+static int hba_slots = 1;
+static int hba_ncq = 0;
+
+#define hba_reg(reg) (*(volatile unsigned long *) (hba_base + (reg)))
+#define port_reg(d,reg) (*(volatile unsigned long *) ((d)->base + (reg)))
+
+/*
+ * ahci_end() ends a request taken off the list, like end_request() does
+ * for CURRENT.
+ */
+static void ahci_end(struct request * req, int uptodate)
+{
+	struct buffer_head * bh;
+
+	if (!uptodate)
+		printk(DEVICE_NAME ": I/O error, dev %04x, sector %d\n\r",
+			req->dev,req->sector);
+	while ((bh = req->bh)) {
+		req->bh = bh->b_reqnext;
+		bh->b_reqnext = NULL;
+		bh->b_uptodate = uptodate;
+		unlock_buffer(bh);
+	}
+	wake_up(&req->waiting);
+	wake_up(&wait_for_request);
+	req->dev = -1;
+}
+
+/*
+ * fill_command() sets up slot 'nr' for an ATA command with data going
+ * to or from 'req' (or nothing, if req is NULL). Returns 0 if the
+ * request has more buffers than PRD entries.
+ */
+static int fill_command(struct ahci_disk * d, int nr, int cmd,
+	unsigned long lba, int count, int tag, struct request * req)
+{
+	struct ahci_cmd_hdr * h = d->cmd_list + nr;
+	struct ahci_cmd_table * t = d->table[nr];
+	struct buffer_head * bh;
+	unsigned char * fis = t->cfis;
+	int n = 0;
+
+	if (req && (bh = req->bh))
+		for ( ; bh ; bh = bh->b_reqnext, n++) {
+			if (n >= AHCI_NR_PRD)
+				return 0;
+			t->prd[n].dba = (unsigned long) bh->b_data;
+			t->prd[n].dbau = 0;
+			t->prd[n].dbc = BLOCK_SIZE-1;
+		}
+	else if (req) {
+		t->prd[0].dba = (unsigned long) req->buffer;
+		t->prd[0].dbau = 0;
+		t->prd[0].dbc = req->nr_sectors*512-1;
+		n = 1;
+	}
+	memset(fis,0,20);
+	fis[0] = 0x27;			/* host to device register FIS */
+	fis[1] = 0x80;			/* it's a command */
+	fis[2] = cmd;
+	fis[4] = lba;
+	fis[5] = lba >> 8;
+	fis[6] = lba >> 16;
+	fis[7] = 0x40;			/* LBA */
+	fis[8] = lba >> 24;
+	if (cmd == ATA_READ_FPDMA || cmd == ATA_WRITE_FPDMA) {
+		fis[3] = count;
+		fis[11] = count >> 8;
+		fis[12] = tag << 3;
+	} else {
+		if (cmd == ATA_READ_DMA || cmd == ATA_WRITE_DMA) {
+			fis[7] |= (lba >> 24) & 0x0f;
+			fis[8] = 0;
+		}
+		fis[12] = count;
+		fis[13] = count >> 8;
+	}
+	h->flags = 5;			/* FIS is 5 dwords */
+	if (req && req->cmd == WRITE)
+		h->flags |= 1<<6;
+	h->prdtl = n;
+	h->prdbc = 0;
+	h->ctba = (unsigned long) t;
+	h->ctbau = 0;
+	return 1;
+}
+
+static void issue_request(struct ahci_disk * d, int nr, struct request * req)
+{
+	int cmd;
+
+	if (d->depth > 1)
+		cmd = (req->cmd == WRITE) ? ATA_WRITE_FPDMA : ATA_READ_FPDMA;
+	else if (d->lba48)
+		cmd = (req->cmd == WRITE) ? ATA_WRITE_DMA_EXT : ATA_READ_DMA_EXT;
+	else
+		cmd = (req->cmd == WRITE) ? ATA_WRITE_DMA : ATA_READ_DMA;
+	if (!fill_command(d,nr,cmd,req->sector,req->nr_sectors,nr,req)) {
+		ahci_end(req,0);
+		return;
+	}
+	d->slot[nr] = req;
+	d->issued |= 1UL << nr;
+	if (d->depth > 1)
+		port_reg(d,PX_SACT) = 1UL << nr;
+	port_reg(d,PX_CI) = 1UL << nr;
+}
+
+static void do_ahci_request(void)
+{
+	struct ahci_disk * d;
+	struct request * req;
+	unsigned long flags;
+	int nr;
+
+	save_flags(flags);
+	cli();
+	while ((req = CURRENT)) {
+		if (MAJOR(req->dev) != MAJOR_NR)
+			panic(DEVICE_NAME ": request list destroyed");
+		d = ahci_disk + DEVICE_NR(req->dev);
+		if (DEVICE_NR(req->dev) >= nr_disks ||
+		    req->sector + req->nr_sectors > d->nr_sects) {
+			CURRENT = blk_next_request(blk_dev+MAJOR_NR);
+			ahci_end(req,0);
+			continue;
+		}
+		for (nr = 0 ; nr < d->depth ; nr++)
+			if (!(d->issued & (1UL << nr)))
+				break;
+		if (nr >= d->depth)
+			break;
+		CURRENT = blk_next_request(blk_dev+MAJOR_NR);
+		issue_request(d,nr,req);
+	}
+	restore_flags(flags);
+}
+
+static int stop_port(struct ahci_disk * d)
+{
+	int i;
+
+	port_reg(d,PX_CMD) &= ~(CMD_ST|CMD_FRE);
+	for (i = 0 ; i < 1000000 ; i++)
+		if (!(port_reg(d,PX_CMD) & (CMD_CR|CMD_FR)))
+			return 1;
+	return 0;
+}
+
+static void start_port(struct ahci_disk * d)
+{
+	int i;
+
+	port_reg(d,PX_SERR) = ~0UL;
+	port_reg(d,PX_IS) = ~0UL;
+	port_reg(d,PX_CMD) |= CMD_FRE;
+	for (i = 0 ; i < 1000000 ; i++)
+		if (!(port_reg(d,PX_TFD) & (TFD_BSY|TFD_DRQ)))
+			break;
+	port_reg(d,PX_CMD) |= CMD_ST;
+}
+
+/*
+ * On an error, everything in flight on the port fails: AHCI leaves no
+ * way to tell which queued command it was. The port is restarted, so
+ * that the requests behind them can go on.
+ */
+static void port_error(struct ahci_disk * d)
+{
+	int nr;
+
+	stop_port(d);
+	for (nr = 0 ; nr < 32 ; nr++)
+		if (d->issued & (1UL << nr)) {
+			d->issued &= ~(1UL << nr);
+			ahci_end(d->slot[nr],0);
+		}
+	start_port(d);
+}
+
+static void ahci_intr(void)
+{
+	struct ahci_disk * d;
+	unsigned long is, pis, active, done;
+	int nr;
+
+	if (!(is = hba_reg(HBA_IS)))
+		return;
+	for (d = ahci_disk ; d < ahci_disk + nr_disks ; d++) {
+		if (!(is & (1UL << d->port)))
+			continue;
+		pis = port_reg(d,PX_IS);
+		port_reg(d,PX_IS) = pis;
+		if (pis & IS_ERROR) {
+			port_error(d);
+			continue;
+		}
+		active = port_reg(d,PX_CI);
+		if (d->depth > 1)
+			active |= port_reg(d,PX_SACT);
+		done = d->issued & ~active;
+		for (nr = 0 ; done ; nr++)
+			if (done & (1UL << nr)) {
+				done &= ~(1UL << nr);
+				d->issued &= ~(1UL << nr);
+				ahci_end(d->slot[nr],1);
+			}
+	}
+	hba_reg(HBA_IS) = is;
+	do_ahci_request();
+}
+
+/*
+ * identify() runs IDENTIFY DEVICE in slot 0, polling, as it is called
+ * before interrupts are on. Returns 0 if the disk doesn't answer.
+ */
+static int identify(struct ahci_disk * d, unsigned short * id)
+{
+	struct ahci_cmd_table * t = d->table[0];
+	int i;
+
+	fill_command(d,0,ATA_IDENTIFY,0,0,0,NULL);
+	d->cmd_list[0].prdtl = 1;
+	t->prd[0].dba = (unsigned long) id;
+	t->prd[0].dbau = 0;
+	t->prd[0].dbc = 511;
+	port_reg(d,PX_CI) = 1;
+	for (i = 0 ; i < 10000000 ; i++)
+		if (!(port_reg(d,PX_CI) & 1))
+			break;
+	if ((port_reg(d,PX_CI) & 1) || (port_reg(d,PX_TFD) & TFD_ERR))
+		return 0;
+	return 1;
+}
+
+static int setup_port(int port, unsigned short * id)
+{
+	struct ahci_disk * d = ahci_disk + nr_disks;
+	unsigned long page;
+	int i;
+
+	d->port = port;
+	d->base = hba_base + 0x100 + port*0x80;
+	if ((port_reg(d,PX_SSTS) & 0x0f) != 3 || port_reg(d,PX_SIG) != SIG_ATA)
+		return 0;
+	if (!stop_port(d))
+		return 0;
+	if (!(page = get_free_page()))
+		return 0;
+	d->cmd_list = (struct ahci_cmd_hdr *) page;
+	port_reg(d,PX_CLB) = page;
+	port_reg(d,PX_CLBU) = 0;
+	port_reg(d,PX_FB) = page + 1024;	/* received FIS area */
+	port_reg(d,PX_FBU) = 0;
+	for (i = 0 ; i < hba_slots ; i++) {
+		if (!(i % TABLES_PER_PAGE) && !(page = get_free_page()))
+			return 0;
+		d->table[i] = (struct ahci_cmd_table *)
+			(page + (i % TABLES_PER_PAGE) * TABLE_SIZE);
+	}
+	start_port(d);
+	if (!identify(d,id))
+		return 0;
+	d->lba48 = (id[83] & (1<<10)) != 0;
+	if (d->lba48)
+		d->nr_sects = id[100] | ((unsigned long) id[101] << 16);
+	else
+		d->nr_sects = id[60] | ((unsigned long) id[61] << 16);
+	d->depth = 1;
+	if (hba_ncq && (id[76] & (1<<8)))
+		d->depth = (id[75] & 0x1f) + 1;
+	if (d->depth > hba_slots)
+		d->depth = hba_slots;
+	port_reg(d,PX_IE) = IS_DHRS | IS_PSS | IS_SDBS | IS_ERROR;
+	printk(DEVICE_NAME "%d: port %d, %d sectors, %d commands queued\n\r",
+		nr_disks,port,d->nr_sects,d->depth);
+	nr_disks++;
+	return 1;
+}
+
+void ahci_init(void)
+{
+	int bus, devfn, irq, port;
+	unsigned long abar, ports;
+	unsigned short * id;
+
+	if (!pci_find_class(PCI_CLASS_STORAGE_SATA,0,&bus,&devfn) ||
+	    pci_read_config_byte(bus,devfn,PCI_CLASS_PROG) != 0x01)
+		return;
+	abar = pci_read_config_dword(bus,devfn,PCI_BASE_ADDRESS_0+5*4);
+	if ((abar & PCI_BASE_ADDRESS_SPACE_IO) || !(abar &= PCI_BASE_ADDRESS_MEM_MASK))
+		return;
+	irq = pci_read_config_byte(bus,devfn,PCI_INTERRUPT_LINE);
+	pci_write_config_word(bus,devfn,PCI_COMMAND,
+		pci_read_config_word(bus,devfn,PCI_COMMAND) |
+		PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+	if (!(hba_base = ioremap(abar)) || !(id = (unsigned short *) get_free_page()))
+		return;
+	hba_reg(HBA_GHC) |= GHC_AE;
+	hba_slots = ((hba_reg(HBA_CAP) >> 8) & 0x1f) + 1;
+	hba_ncq = (hba_reg(HBA_CAP) & CAP_SNCQ) != 0;
+	ports = hba_reg(HBA_PI);
+	for (port = 0 ; port < AHCI_MAX_PORTS && nr_disks < AHCI_MAX_DISKS ; port++)
+		if (ports & (1UL << port))
+			setup_port(port,id);
+	free_page((unsigned long) id);
+	if (!nr_disks)
+		return;
+	if (pci_request_irq(irq,ahci_intr)) {
+		printk(DEVICE_NAME ": can't use irq %d\n\r",irq);
+		nr_disks = 0;
+		return;
+	}
+	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	blk_dev[MAJOR_NR].max_sectors = AHCI_MAX_SECTORS;
+	hba_reg(HBA_IS) = ~0UL;
+	hba_reg(HBA_GHC) |= GHC_IE;
+}
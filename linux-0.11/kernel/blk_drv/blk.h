@@ -1,7 +1,7 @@
 #ifndef _BLK_H
 #define _BLK_H
 
-#define NR_BLK_DEV	7
+#define NR_BLK_DEV	10
 /*
  * NR_REQUEST is the number of entries in the request-queue.
  * NOTE that writes may use only the low 2/3 of these: reads
@@ -30,6 +30,9 @@ struct request {
 	struct task_struct * waiting;
 	struct buffer_head * bh;
 	struct request * next;
+	unsigned long deadline;		/* in jiffies */
+	struct request * fifo_next;
+	struct buffer_head * bhtail;	/* last buffer of the bh chain */
 };
 
 /*
@@ -42,14 +45,32 @@ struct request {
 ((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
 (s1)->sector < (s2)->sector))))
 
+/*
+ * An I/O scheduler decides where add_request() puts a request in the
+ * list of a major, after current_request, which is in progress already.
+ * next_request, if there is one, picks the request that goes after a
+ * finished one. The default is just the next one in the list.
+ */
+struct blk_dev_struct;
+
+struct elevator {
+	char * name;
+	void (*add_request)(struct blk_dev_struct * dev, struct request * req);
+	struct request * (*next_request)(struct blk_dev_struct * dev);
+};
+
 struct blk_dev_struct {
 	void (*request_fn)(void);
 	struct request * current_request;
+	struct elevator * elevator;
+	struct request * fifo[2];	/* READ and WRITE, oldest first */
+	int max_sectors;		/* merge requests up to this size */
 };
 
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
 extern struct request request[NR_REQUEST];
 extern struct task_struct * wait_for_request;
+extern struct request * blk_next_request(struct blk_dev_struct * dev);
 
 #ifdef MAJOR_NR
 
@@ -84,6 +105,30 @@ extern struct task_struct * wait_for_request;
 #define DEVICE_ON(device)
 #define DEVICE_OFF(device)
 
+#elif (MAJOR_NR == 7)
+/* AHCI SATA disks */
+#define DEVICE_NAME "ahci"
+#define DEVICE_REQUEST do_ahci_request
+#define DEVICE_NR(device) (MINOR(device))
+#define DEVICE_ON(device)
+#define DEVICE_OFF(device)
+
+#elif (MAJOR_NR == 8)
+/* virtio block device */
+#define DEVICE_NAME "virtio"
+#define DEVICE_REQUEST do_virtio_request
+#define DEVICE_NR(device) (MINOR(device))
+#define DEVICE_ON(device)
+#define DEVICE_OFF(device)
+
+#elif (MAJOR_NR == 9)
+/* null block device, for benchmarks */
+#define DEVICE_NAME "nullblk"
+#define DEVICE_REQUEST do_nullblk_request
+#define DEVICE_NR(device) (MINOR(device))
+#define DEVICE_ON(device)
+#define DEVICE_OFF(device)
+
 #elif
 /* unknown blk device */
 #error "unknown blk device"
@@ -106,22 +151,39 @@ static inline void unlock_buffer(struct buffer_head * bh)
 	wake_up(&bh->b_wait);
 }
 
+/*
+ * A merged request carries a chain of buffers, linked by b_reqnext, and
+ * its sectors go to one buffer after the other. Drivers that take merged
+ * requests call next_buffer() when they are done with the first buffer
+ * of CURRENT, ie every 2 sectors: it marks that buffer done and points
+ * CURRENT->buffer at the next one.
+ */
+static inline void next_buffer(int uptodate)
+{
+	struct buffer_head * bh = CURRENT->bh;
+
+	CURRENT->bh = bh->b_reqnext;
+	bh->b_reqnext = NULL;
+	bh->b_uptodate = uptodate;
+	unlock_buffer(bh);
+	if (CURRENT->bh)
+		CURRENT->buffer = CURRENT->bh->b_data;
+}
+
 static inline void end_request(int uptodate)
 {
 	DEVICE_OFF(CURRENT->dev);
-	if (CURRENT->bh) {
-		CURRENT->bh->b_uptodate = uptodate;
-		unlock_buffer(CURRENT->bh);
-	}
 	if (!uptodate) {
 		printk(DEVICE_NAME " I/O error\n\r");
 		printk("dev %04x, block %d\n\r",CURRENT->dev,
-			CURRENT->bh->b_blocknr);
+			CURRENT->bh ? CURRENT->bh->b_blocknr : -1);
 	}
+	while (CURRENT->bh)
+		next_buffer(uptodate);
 	wake_up(&CURRENT->waiting);
 	wake_up(&wait_for_request);
 	CURRENT->dev = -1;
-	CURRENT = CURRENT->next;
+	CURRENT = blk_next_request(blk_dev+MAJOR_NR);
 }
 
 #define INIT_REQUEST \
@@ -122,6 +122,21 @@ static unsigned char command = 0;
 unsigned char selected = 0;
 struct task_struct * wait_on_floppy_select = NULL;
 
+/*
+ * The track buffer holds the last cylinder (both sides) read from a
+ * diskette. A read that misses gets the whole cylinder with one command,
+ * so the blocks after it come from memory instead of costing a
+ * revolution each. It has to be DMA-able: below 1MB and within 64kB,
+ * which is why track_area is twice as big as it needs to be.
+ */
+#define TRACK_BUFFER_SIZE (2*18*512)
+static char track_area[2*TRACK_BUFFER_SIZE];
+static char * track_buffer = NULL;
+static int buffer_drive = -1;
+static int buffer_track = -1;
+static struct floppy_struct * buffer_type = NULL;
+static int read_track = 0;	/* the command reads into the track buffer */
+
 void floppy_deselect(unsigned int nr)
 {
 	if (nr != (current_DOR & 3))
@@ -145,6 +160,8 @@ repeat:
 	if ((current_DOR & 3) != nr)
 		goto repeat;
 	if (inb(FD_DIR) & 0x80) {
+		if (nr == buffer_drive)
+			buffer_drive = -1;
 		floppy_off(nr);
 		return 1;
 	}
@@ -160,9 +177,13 @@ __asm__("cld ; rep ; movsl" \
 static void setup_DMA(void)
 {
 	long addr = (long) CURRENT->buffer;
+	int count = BLOCK_SIZE;
 
 	cli();
-	if (addr >= 0x100000) {
+	if (read_track) {
+		addr = (long) track_buffer;
+		count = floppy->sect*floppy->head*512;
+	} else if (addr >= 0x100000) {
 		addr = (long) tmp_floppy_area;
 		if (command == FD_WRITE)
 			copy_buffer(CURRENT->buffer,tmp_floppy_area);
@@ -182,10 +203,11 @@ static void setup_DMA(void)
 	addr >>= 8;
 /* bits 16-19 of addr */
 	immoutb_p(addr,0x81);
-/* low 8 bits of count-1 (1024-1=0x3ff) */
-	immoutb_p(0xff,5);
+	count--;
+/* low 8 bits of count-1 */
+	immoutb_p(count,5);
 /* high 8 bits of count-1 */
-	immoutb_p(3,5);
+	immoutb_p(count >> 8,5);
 /* activate DMA 2 */
 	immoutb_p(0|2,10);
 	sti();
@@ -232,6 +254,8 @@ static int result(void)
 
 static void bad_flp_intr(void)
 {
+	if (read_track)
+		buffer_drive = -1;
 	CURRENT->errors++;
 	if (CURRENT->errors > MAX_ERRORS) {
 		floppy_deselect(current_drive);
@@ -259,7 +283,14 @@ static void rw_interrupt(void)
 		do_fd_request();
 		return;
 	}
-	if (command == FD_READ && (unsigned long)(CURRENT->buffer) >= 0x100000)
+	if (read_track) {
+		buffer_drive = current_drive;
+		buffer_track = track;
+		buffer_type = floppy;
+		copy_buffer(track_buffer + ((CURRENT->sector %
+			(floppy->sect*floppy->head)) << 9),CURRENT->buffer);
+	} else if (command == FD_READ &&
+	    (unsigned long)(CURRENT->buffer) >= 0x100000)
 		copy_buffer(tmp_floppy_area,CURRENT->buffer);
 	floppy_deselect(current_drive);
 	end_request(1);
@@ -416,7 +447,7 @@ static void floppy_on_interrupt(void)
 
 void do_fd_request(void)
 {
-	unsigned int block;
+	unsigned int block, cyl_sectors;
 
 	seek = 0;
 	if (reset) {
@@ -429,14 +460,25 @@ void do_fd_request(void)
 	}
 	INIT_REQUEST;
 	floppy = (MINOR(CURRENT->dev)>>2) + floppy_type;
-	if (current_drive != CURRENT_DEV)
-		seek = 1;
-	current_drive = CURRENT_DEV;
 	block = CURRENT->sector;
 	if (block+2 > floppy->size) {
 		end_request(0);
 		goto repeat;
 	}
+	cyl_sectors = floppy->sect*floppy->head;
+	if (CURRENT_DEV == buffer_drive && floppy == buffer_type &&
+	    block / cyl_sectors == buffer_track) {
+		if (CURRENT->cmd == READ) {
+			copy_buffer(track_buffer + ((block % cyl_sectors) << 9),
+				CURRENT->buffer);
+			end_request(1);
+			goto repeat;
+		}
+		buffer_drive = -1;
+	}
+	if (current_drive != CURRENT_DEV)
+		seek = 1;
+	current_drive = CURRENT_DEV;
 	sector = block % floppy->sect;
 	block /= floppy->sect;
 	head = block % floppy->head;
@@ -444,6 +486,17 @@ void do_fd_request(void)
 	seek_track = track << floppy->stretch;
 	if (seek_track != current_track)
 		seek = 1;
+/*
+ * A read reads the whole cylinder - unless that failed already: one bad
+ * sector mustn't take the rest of the cylinder with it, so the retries
+ * read just the two sectors of the request.
+ */
+	read_track = (CURRENT->cmd == READ && track_buffer && !CURRENT->errors);
+	if (read_track) {
+		buffer_drive = -1;
+		head = 0;
+		sector = 0;
+	}
 	sector++;
 	if (CURRENT->cmd == READ)
 		command = FD_READ;
@@ -456,6 +509,12 @@ void do_fd_request(void)
 
 void floppy_init(void)
 {
+	track_buffer = track_area;
+	if (((long) track_buffer ^ ((long) track_buffer+TRACK_BUFFER_SIZE-1))
+	    & ~0xffff)
+		track_buffer += TRACK_BUFFER_SIZE;
+	if ((long) track_buffer + TRACK_BUFFER_SIZE > 0x100000)
+		track_buffer = NULL;
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
 	set_trap_gate(0x26,&floppy_interrupt);
 	outb(inb_p(0x21)&~0x40,0x21);
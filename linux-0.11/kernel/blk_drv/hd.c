@@ -18,6 +18,7 @@
 #include <linux/fs.h>
 #include <linux/kernel.h>
 #include <linux/hdreg.h>
+#include <linux/pci.h>
 #include <asm/system.h>
 #include <asm/io.h>
 #include <asm/segment.h>
@@ -30,6 +31,8 @@ outb_p(0x80|addr,0x70); \
 inb_p(0x71); \
 })
 
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
 /* Max read/write errors/sector */
 #define MAX_ERRORS	7
 #define MAX_HD		2
@@ -58,6 +61,46 @@ static struct hd_struct {
 	long nr_sects;
 } hd[5*MAX_HD]={{0,0},};
 
+/*
+ * Read/write commands issued, and how many of them didn't start where
+ * the previous one on that drive ended (ie needed a seek).
+ */
+static unsigned long hd_commands = 0;
+static unsigned long hd_seeks = 0;
+static unsigned long hd_next_sect[MAX_HD] = {0,};
+static unsigned long hd_interrupts = 0;
+
+/*
+ * Multiple mode: the first request for a drive (and the first after a
+ * reset) asks it with IDENTIFY how many sectors it can transfer per
+ * interrupt, and sets that with SET MULTIPLE MODE. mult_count is what
+ * the drive was set to (0 = single sectors), and hd_mult the number of
+ * sectors per interrupt of the command in progress. hd_sent is how many
+ * of them write_intr() gave the drive last.
+ */
+static int identified[MAX_HD] = {0,};
+static int mult_req[MAX_HD] = {0,};
+static int mult_count[MAX_HD] = {0,};
+static int hd_mult = 1;
+static int hd_sent = 0;
+static unsigned short hd_ident[256];
+
+/*
+ * Bus-master DMA: hd_init() looks for a PCI IDE controller that can do
+ * it, and drives that say so in IDENTIFY then transfer whole requests
+ * by DMA, one interrupt per request and no copying by the CPU. The PRD
+ * table (a page, so it never crosses 64kB) lists the buffers of the
+ * request. A drive that gets a DMA error is switched back to PIO.
+ */
+#define NR_PRD	(4096/sizeof(struct prd))
+
+static struct prd {
+	unsigned long addr;
+	unsigned long count;		/* byte count, and BM_PRD_EOT */
+} * hd_prd = NULL;
+static unsigned int bmide_base = 0;
+static int use_dma[MAX_HD] = {0,};
+
 #define port_read(port,buf,nr) \
 __asm__("cld;rep;insw"::"d" (port),"D" (buf),"c" (nr))
 
@@ -247,41 +290,137 @@ static void bad_rw_intr(void)
 		reset = 1;
 }
 
-static void read_intr(void)
+/*
+ * hd_advance() moves CURRENT past a sector that has been transferred,
+ * on to the next buffer of the request every 2 sectors. Returns 0 when
+ * the request is done.
+ */
+static int hd_advance(void)
 {
-	if (win_result()) {
-		bad_rw_intr();
-		do_hd_request();
-		return;
-	}
-	port_read(HD_DATA,CURRENT->buffer,256);
-	CURRENT->errors = 0;
 	CURRENT->buffer += 512;
 	CURRENT->sector++;
-	if (--CURRENT->nr_sectors) {
-		do_hd = &read_intr;
+	if (!--CURRENT->nr_sectors)
+		return 0;
+	if (CURRENT->bh && !(CURRENT->nr_sectors & 1))
+		next_buffer(1);
+	return 1;
+}
+
+/*
+ * write_sectors() gives the drive the next nr sectors of CURRENT, which
+ * may be spread over several buffers. CURRENT itself is only advanced
+ * when the drive says they have been written.
+ */
+static void write_sectors(int nr)
+{
+	struct buffer_head * bh = CURRENT->bh;
+	char * buf = CURRENT->buffer;
+	int left = CURRENT->nr_sectors;
+
+	while (nr-- > 0) {
+		port_write(HD_DATA,buf,256);
+		buf += 512;
+		if (bh && !(--left & 1) && (bh = bh->b_reqnext))
+			buf = bh->b_data;
+	}
+}
+
+/*
+ * build_prd() fills the PRD table with the buffers of CURRENT. Blocks
+ * that happen to be next to each other in memory share an entry, as
+ * long as it doesn't cross 64kB or get longer than that. A byte count
+ * of 64kB is written as 0, the rest of the dword has to be 0 (but for
+ * BM_PRD_EOT). Returns 0 if the table is too small.
+ */
+static int build_prd(void)
+{
+	struct buffer_head * bh = CURRENT->bh;
+	unsigned long addr = (unsigned long) CURRENT->buffer;
+	struct prd * p = hd_prd - 1, * q;
+	int left = CURRENT->nr_sectors, len;
+
+	while (left > 0) {
+		len = (left & 1) ? 512 : BLOCK_SIZE;
+		if (p >= hd_prd && p->addr + p->count == addr &&
+		    p->count + len <= 0x10000 &&
+		    (p->addr & ~0xffffUL) == ((addr+len-1) & ~0xffffUL))
+			p->count += len;
+		else {
+			if (++p >= hd_prd + NR_PRD)
+				return 0;
+			p->addr = addr;
+			p->count = len;
+		}
+		left -= len >> 9;
+		if (left && bh && (bh = bh->b_reqnext))
+			addr = (unsigned long) bh->b_data;
+		else
+			addr += len;
+	}
+	for (q = hd_prd ; q <= p ; q++)
+		q->count &= 0xffff;
+	p->count |= BM_PRD_EOT;
+	return 1;
+}
+
+static void dma_intr(void)
+{
+	int stat;
+
+	hd_interrupts++;
+	outb(0,bmide_base+BM_COMMAND);
+	stat = inb(bmide_base+BM_STATUS);
+	outb(stat|BM_STAT_ERR|BM_STAT_INTR,bmide_base+BM_STATUS);
+	if (win_result() || (stat & BM_STAT_ERR)) {
+		printk("hd%d: DMA error, using PIO\n\r",CURRENT_DEV);
+		use_dma[CURRENT_DEV] = 0;
+		bad_rw_intr();
+		do_hd_request();
 		return;
 	}
 	end_request(1);
 	do_hd_request();
 }
 
-static void write_intr(void)
+static void read_intr(void)
 {
+	int i;
+
+	hd_interrupts++;
 	if (win_result()) {
 		bad_rw_intr();
 		do_hd_request();
 		return;
 	}
-	if (--CURRENT->nr_sectors) {
-		CURRENT->sector++;
-		CURRENT->buffer += 512;
-		do_hd = &write_intr;
-		port_write(HD_DATA,CURRENT->buffer,256);
+	for (i = hd_mult ; i > 0 ; i--) {
+		port_read(HD_DATA,CURRENT->buffer,256);
+		CURRENT->errors = 0;
+		if (!hd_advance()) {
+			end_request(1);
+			do_hd_request();
+			return;
+		}
+	}
+	do_hd = &read_intr;
+}
+
+static void write_intr(void)
+{
+	hd_interrupts++;
+	if (win_result()) {
+		bad_rw_intr();
+		do_hd_request();
 		return;
 	}
-	end_request(1);
-	do_hd_request();
+	for ( ; hd_sent > 0 ; hd_sent--)
+		if (!hd_advance()) {
+			end_request(1);
+			do_hd_request();
+			return;
+		}
+	hd_sent = MIN(hd_mult,CURRENT->nr_sectors);
+	do_hd = &write_intr;
+	write_sectors(hd_sent);
 }
 
 static void recal_intr(void)
@@ -291,6 +430,42 @@ static void recal_intr(void)
 	do_hd_request();
 }
 
+/*
+ * Word 47 of the IDENTIFY data has the most sectors the drive can do per
+ * interrupt in its low byte. A drive that doesn't know IDENTIFY (or
+ * multiple mode) just stays with single sectors.
+ */
+static void identify_intr(void)
+{
+	int drive = CURRENT_DEV, max, n;
+
+	if (win_result()) {
+		do_hd_request();
+		return;
+	}
+	port_read(HD_DATA,hd_ident,256);
+	max = MIN(hd_ident[47] & 0xff, HD_MULT_COUNT);
+	for (n = 1 ; n*2 <= max ; n *= 2)
+		/* nothing */ ;
+	if (n > 1)
+		mult_req[drive] = n;
+	if (bmide_base && (hd_ident[49] & 0x100))
+		use_dma[drive] = 1;
+	do_hd_request();
+}
+
+static void setmult_intr(void)
+{
+	int drive = CURRENT_DEV;
+
+	if (!win_result()) {
+		mult_count[drive] = mult_req[drive];
+		printk("hd%d: %d sectors per interrupt\n\r",drive,mult_count[drive]);
+	}
+	mult_req[drive] = 0;
+	do_hd_request();
+}
+
 void do_hd_request(void)
 {
 	int i,r = 0;
@@ -301,7 +476,7 @@ void do_hd_request(void)
 	INIT_REQUEST;
 	dev = MINOR(CURRENT->dev);
 	block = CURRENT->sector;
-	if (dev >= 5*NR_HD || block+2 > hd[dev].nr_sects) {
+	if (dev >= 5*NR_HD || block+CURRENT->nr_sectors > hd[dev].nr_sects) {
 		end_request(0);
 		goto repeat;
 	}
@@ -316,6 +491,9 @@ void do_hd_request(void)
 	if (reset) {
 		reset = 0;
 		recalibrate = 1;
+		for (i=0 ; i<MAX_HD ; i++)
+			identified[i] = mult_count[i] = mult_req[i] =
+				use_dma[i] = 0;
 		reset_hd(CURRENT_DEV);
 		return;
 	}
@@ -325,23 +503,87 @@ void do_hd_request(void)
 			WIN_RESTORE,&recal_intr);
 		return;
 	}	
-	if (CURRENT->cmd == WRITE) {
-		hd_out(dev,nsect,sec,head,cyl,WIN_WRITE,&write_intr);
+	if (!identified[dev]) {
+		identified[dev] = 1;
+		hd_out(dev,0,0,0,0,WIN_IDENTIFY,&identify_intr);
+		return;
+	}
+	if (mult_req[dev]) {
+		hd_out(dev,mult_req[dev],0,0,0,WIN_SETMULT,&setmult_intr);
+		return;
+	}
+	hd_mult = mult_count[dev] ? mult_count[dev] : 1;
+	hd_commands++;
+	if (CURRENT->sector + hd[MINOR(CURRENT->dev)].start_sect != hd_next_sect[dev])
+		hd_seeks++;
+	hd_next_sect[dev] = CURRENT->sector + hd[MINOR(CURRENT->dev)].start_sect + nsect;
+	if (use_dma[dev] && CURRENT->bh && build_prd()) {
+		outb(0,bmide_base+BM_COMMAND);
+		outl((unsigned long) hd_prd,bmide_base+BM_PRD);
+		outb(inb(bmide_base+BM_STATUS)|BM_STAT_ERR|BM_STAT_INTR,
+			bmide_base+BM_STATUS);
+		hd_out(dev,nsect,sec,head,cyl,
+			CURRENT->cmd == WRITE ? WIN_WRITEDMA : WIN_READDMA,
+			&dma_intr);
+		outb(CURRENT->cmd == WRITE ? BM_CMD_START : BM_CMD_START|BM_CMD_READ,
+			bmide_base+BM_COMMAND);
+	} else if (CURRENT->cmd == WRITE) {
+		hd_out(dev,nsect,sec,head,cyl,
+			hd_mult > 1 ? WIN_MULTWRITE : WIN_WRITE,&write_intr);
 		for(i=0 ; i<3000 && !(r=inb_p(HD_STATUS)&DRQ_STAT) ; i++)
 			/* nothing */ ;
 		if (!r) {
 			bad_rw_intr();
 			goto repeat;
 		}
-		port_write(HD_DATA,CURRENT->buffer,256);
+		hd_sent = MIN(hd_mult,nsect);
+		write_sectors(hd_sent);
 	} else if (CURRENT->cmd == READ) {
-		hd_out(dev,nsect,sec,head,cyl,WIN_READ,&read_intr);
+		hd_out(dev,nsect,sec,head,cyl,
+			hd_mult > 1 ? WIN_MULTREAD : WIN_READ,&read_intr);
 	} else
 		panic("unknown hd-command");
 }
 
+void show_hd_stat(void)
+{
+	printk("hd: %d commands, %d seeks, %d interrupts\n\r",
+		hd_commands,hd_seeks,hd_interrupts);
+}
+
+/*
+ * hd_dma_init() looks for a PCI IDE controller with bus-master DMA that
+ * has its primary channel at the legacy ports, where we drive it.
+ */
+static void hd_dma_init(void)
+{
+	int i, bus, devfn, prog;
+	unsigned long base;
+
+	for (i = 0 ; pci_find_class(PCI_CLASS_STORAGE_IDE,i,&bus,&devfn) ; i++) {
+		prog = pci_read_config_byte(bus,devfn,PCI_CLASS_PROG);
+		if (!(prog & 0x80) || (prog & 0x01))
+			continue;
+		base = pci_read_config_dword(bus,devfn,PCI_BASE_ADDRESS_0+4*4);
+		if (!(base & PCI_BASE_ADDRESS_SPACE_IO) ||
+		    !(base & PCI_BASE_ADDRESS_IO_MASK))
+			continue;
+		if (!(hd_prd = (struct prd *) get_free_page()))
+			return;
+		pci_write_config_word(bus,devfn,PCI_COMMAND,
+			pci_read_config_word(bus,devfn,PCI_COMMAND) |
+			PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+		bmide_base = base & PCI_BASE_ADDRESS_IO_MASK;
+		printk("hd: bus-master DMA at 0x%04x\n\r",bmide_base);
+		return;
+	}
+}
+
 void hd_init(void)
 {
+#ifdef HD_DMA
+	hd_dma_init();
+#endif
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
 	set_intr_gate(0x2E,&hd_interrupt);
 	outb_p(inb_p(0x21)&0xfb,0x21);
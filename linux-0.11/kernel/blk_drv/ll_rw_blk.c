@@ -8,9 +8,11 @@
  * This handles all read/write requests to block devices
  */
 #include <errno.h>
+#include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <asm/system.h>
+#include <asm/segment.h>
 
 #include "blk.h"
 
@@ -28,6 +30,8 @@ struct task_struct * wait_for_request = NULL;
 /* blk_dev_struct is:
  *	do_request-address
  *	next-request
+ *	I/O scheduler, set up by blk_dev_init()
+ *	read and write fifos
  */
 struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
 	{ NULL, NULL },		/* no_dev */
@@ -36,9 +40,16 @@ struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
 	{ NULL, NULL },		/* dev hd */
 	{ NULL, NULL },		/* dev ttyx */
 	{ NULL, NULL },		/* dev tty */
-	{ NULL, NULL }		/* dev lp */
+	{ NULL, NULL },		/* dev lp */
+	{ NULL, NULL },		/* dev ahci */
+	{ NULL, NULL },		/* dev virtio */
+	{ NULL, NULL }		/* dev nullblk */
 };
 
+/* how long (in jiffies) the deadline scheduler lets a request wait */
+#define READ_EXPIRE	(HZ/2)
+#define WRITE_EXPIRE	(5*HZ)
+
 static inline void lock_buffer(struct buffer_head * bh)
 {
 	cli();
@@ -63,6 +74,150 @@ static inline void unlock_buffer(struct buffer_head * bh)
 	wake_up(&bh->b_wait);
 }
 
+/*
+ * The original elevator: one pass of insertion sort, reads before writes.
+ */
+static void elevator_add(struct blk_dev_struct * dev, struct request * req)
+{
+	struct request * tmp = dev->current_request;
+
+	for ( ; tmp->next ; tmp=tmp->next)
+		if ((IN_ORDER(tmp,req) || 
+		    !IN_ORDER(tmp,tmp->next)) &&
+		    IN_ORDER(req,tmp->next))
+			break;
+	req->next=tmp->next;
+	tmp->next=req;
+}
+
+/*
+ * C-SCAN serves requests in one sweep up the disk, starting at the one in
+ * progress. Requests before that wait for the next sweep, which starts at
+ * the lowest one again. Reads and writes are treated alike.
+ */
+#define BEFORE(s1,s2) \
+((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
+(s1)->sector < (s2)->sector))
+
+static inline int cscan_before(struct request * head,
+	struct request * s1, struct request * s2)
+{
+	int next1 = BEFORE(s1,head), next2 = BEFORE(s2,head);
+
+	if (next1 != next2)
+		return next2;
+	return BEFORE(s1,s2);
+}
+
+static void cscan_add(struct blk_dev_struct * dev, struct request * req)
+{
+	struct request * head = dev->current_request, * tmp;
+
+	for (tmp = head ; tmp->next ; tmp=tmp->next)
+		if (cscan_before(head,req,tmp->next))
+			break;
+	req->next=tmp->next;
+	tmp->next=req;
+}
+
+/*
+ * The deadline scheduler sorts like C-SCAN, but when the oldest read or
+ * write has waited past its deadline, it goes next, and the sweep goes
+ * on from there. Reads are checked first.
+ */
+static struct request * deadline_next(struct blk_dev_struct * dev)
+{
+	struct request * done = dev->current_request;
+	struct request * req = NULL, * rest, ** pp;
+
+	if (dev->fifo[READ] && (long) (jiffies - dev->fifo[READ]->deadline) >= 0)
+		req = dev->fifo[READ];
+	else if (dev->fifo[WRITE] &&
+	    (long) (jiffies - dev->fifo[WRITE]->deadline) >= 0)
+		req = dev->fifo[WRITE];
+	if (!req || req == done->next)
+		return done->next;
+	for (pp = &done->next ; *pp != req ; pp = &(*pp)->next)
+		/* nothing */ ;
+	*pp = req->next;
+	rest = done->next;
+	req->next = NULL;
+	dev->current_request = req;
+	while ((done = rest)) {
+		rest = rest->next;
+		cscan_add(dev,done);
+	}
+	return req;
+}
+
+static struct elevator elevators[NR_ELEVATORS] = {
+	{ "elevator", elevator_add, NULL },
+	{ "cscan", cscan_add, NULL },
+	{ "deadline", cscan_add, deadline_next }
+};
+
+/*
+ * Every request is also kept on the fifo of its direction, whatever the
+ * scheduler, so that it can be changed at any time.
+ */
+static void fifo_remove(struct blk_dev_struct * dev, struct request * req)
+{
+	struct request ** pp;
+
+	for (pp = &dev->fifo[req->cmd] ; *pp ; pp = &(*pp)->fifo_next)
+		if (*pp == req) {
+			*pp = req->fifo_next;
+			break;
+		}
+}
+
+/*
+ * blk_next_request() is called by end_request(), with interrupts off,
+ * to find the request that follows the one that just finished.
+ */
+struct request * blk_next_request(struct blk_dev_struct * dev)
+{
+	fifo_remove(dev,dev->current_request);
+	if (dev->elevator->next_request)
+		return (dev->elevator->next_request)(dev);
+	return dev->current_request->next;
+}
+
+/*
+ * merge_request() tries to add the buffer to a queued request for the
+ * blocks just before or after it, so that the driver can do both with
+ * one command. The request in progress can't be changed anymore.
+ * Called with interrupts off; returns 1 if it merged.
+ */
+static int merge_request(struct blk_dev_struct * dev, int rw,
+	struct buffer_head * bh)
+{
+	struct request * req;
+	unsigned long sector = bh->b_blocknr<<1;
+
+	if (dev->max_sectors <= 2 || !(req = dev->current_request))
+		return 0;
+	while ((req = req->next)) {
+		if (req->dev != bh->b_dev || req->cmd != rw || !req->bh ||
+		    req->nr_sectors + 2 > dev->max_sectors)
+			continue;
+		if (req->sector + req->nr_sectors == sector) {
+			req->bhtail->b_reqnext = bh;
+			req->bhtail = bh;
+		} else if (sector + 2 == req->sector) {
+			bh->b_reqnext = req->bh;
+			req->bh = bh;
+			req->buffer = bh->b_data;
+			req->sector = sector;
+		} else
+			continue;
+		req->nr_sectors += 2;
+		bh->b_dirt = 0;
+		return 1;
+	}
+	return 0;
+}
+
 /*
  * add-request adds a request to the linked list.
  * It disables interrupts so that it can muck with the
@@ -70,25 +225,24 @@ static inline void unlock_buffer(struct buffer_head * bh)
  */
 static void add_request(struct blk_dev_struct * dev, struct request * req)
 {
-	struct request * tmp;
+	struct request ** pp;
 
 	req->next = NULL;
+	req->fifo_next = NULL;
+	req->deadline = jiffies + (req->cmd == READ ? READ_EXPIRE : WRITE_EXPIRE);
 	cli();
 	if (req->bh)
 		req->bh->b_dirt = 0;
-	if (!(tmp = dev->current_request)) {
+	for (pp = &dev->fifo[req->cmd] ; *pp ; pp = &(*pp)->fifo_next)
+		/* nothing */ ;
+	*pp = req;
+	if (!dev->current_request) {
 		dev->current_request = req;
 		sti();
 		(dev->request_fn)();
 		return;
 	}
-	for ( ; tmp->next ; tmp=tmp->next)
-		if ((IN_ORDER(tmp,req) || 
-		    !IN_ORDER(tmp,tmp->next)) &&
-		    IN_ORDER(req,tmp->next))
-			break;
-	req->next=tmp->next;
-	tmp->next=req;
+	(dev->elevator->add_request)(dev,req);
 	sti();
 }
 
@@ -114,7 +268,14 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 		unlock_buffer(bh);
 		return;
 	}
+	bh->b_reqnext = NULL;
 repeat:
+	cli();
+	if (merge_request(major+blk_dev,rw,bh)) {
+		sti();
+		return;
+	}
+	sti();
 /* we don't allow the write-requests to fill up the queue completely:
  * we want some room for reads: they take precedence. The last third
  * of the requests are only for reads.
@@ -145,6 +306,7 @@ repeat:
 	req->buffer = bh->b_data;
 	req->waiting = NULL;
 	req->bh = bh;
+	req->bhtail = bh;
 	req->next = NULL;
 	add_request(major+blk_dev,req);
 }
@@ -187,4 +349,40 @@ void blk_dev_init(void)
 		request[i].dev = -1;
 		request[i].next = NULL;
 	}
+	for (i=0 ; i<NR_BLK_DEV ; i++) {
+		blk_dev[i].elevator = elevators + ELV_ELEVATOR;
+		blk_dev[i].max_sectors = 2;
+	}
+	blk_dev[3].max_sectors = HD_MAX_SECTORS;
+	blk_dev[1].elevator = elevators + RD_ELEVATOR;
+	blk_dev[2].elevator = elevators + FD_ELEVATOR;
+	blk_dev[3].elevator = elevators + HD_ELEVATOR;
+}
+
+/*
+ * blk_ioctl() gets or sets the I/O scheduler of the major of a block
+ * device. The new one takes effect for the requests added from now on.
+ */
+int blk_ioctl(int dev, int cmd, int arg)
+{
+	struct blk_dev_struct * bdev;
+
+	if (MAJOR(dev) >= NR_BLK_DEV || !blk_dev[MAJOR(dev)].request_fn)
+		return -ENODEV;
+	bdev = blk_dev + MAJOR(dev);
+	switch (cmd) {
+		case BLKELVGET:
+			verify_area((void *) arg,4);
+			put_fs_long(bdev->elevator - elevators,(unsigned long *) arg);
+			return 0;
+		case BLKELVSET:
+			if (!suser())
+				return -EPERM;
+			if (arg < 0 || arg >= NR_ELEVATORS)
+				return -EINVAL;
+			bdev->elevator = elevators + arg;
+			return 0;
+		default:
+			return -EINVAL;
+	}
 }
@@ -0,0 +1,103 @@
+/*
+ *  linux/kernel/blk_drv/nullblk.c
+ */
+
+/*
+ * nullblk.c is a block device without a device, for measuring what the
+ * buffer cache and the request queue cost by themselves. Each minor of
+ * major 9 is NULLBLK_BLOCKS blocks big, and the minor says how requests
+ * are completed:
+ *
+ *	0	at once, without touching the data
+ *	1	NULLBLK_DELAY jiffies later, from a timer, one at a time
+ *	2	at once, from memory: written blocks read back as written,
+ *		the others as zeroes. Pages are taken as blocks are first
+ *		written, and never given back.
+ *
+ * Minor 2 is the nearest thing to a ramdisk that the block layer can't
+ * tell from a real disk: requests are merged (up to NULLBLK_MAX_SECTORS)
+ * and scheduled like the harddisk's.
+ */
+
+#include <string.h>
+
+#include <linux/config.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/system.h>
+
+#define MAJOR_NR 9
+#include "blk.h"
+
+/* the pages behind minor 2, 4 blocks each */
+static unsigned long nullblk_pages[(NULLBLK_BLOCKS+3)/4];
+static int nullblk_busy = 0;
+
+static int nullblk_memory(void)
+{
+	unsigned long block = CURRENT->sector >> 1;
+	int n = CURRENT->nr_sectors >> 1;
+	char * page, * addr;
+
+	for ( ; n-- > 0 ; block++) {
+		page = (char *) nullblk_pages[block >> 2];
+		if (!page && CURRENT->cmd == WRITE) {
+			if (!(page = (char *) get_free_page()))
+				return 0;
+			nullblk_pages[block >> 2] = (unsigned long) page;
+		}
+		addr = page + (block & 3) * BLOCK_SIZE;
+		if (CURRENT->cmd == WRITE)
+			memcpy(addr,CURRENT->buffer,BLOCK_SIZE);
+		else if (page)
+			memcpy(CURRENT->buffer,addr,BLOCK_SIZE);
+		else
+			memset(CURRENT->buffer,0,BLOCK_SIZE);
+		if (CURRENT->bh)
+			next_buffer(1);
+		else
+			CURRENT->buffer += BLOCK_SIZE;
+	}
+	return 1;
+}
+
+static void nullblk_timer(void)
+{
+	nullblk_busy = 0;
+	end_request(1);
+	do_nullblk_request();
+}
+
+void do_nullblk_request(void)
+{
+	if (nullblk_busy)
+		return;
+	INIT_REQUEST;
+	if (CURRENT->sector + CURRENT->nr_sectors > 2*NULLBLK_BLOCKS) {
+		end_request(0);
+		goto repeat;
+	}
+	switch (CURRENT_DEV) {
+		case 0:
+			end_request(1);
+			goto repeat;
+		case 1:
+			nullblk_busy = 1;
+			add_timer(NULLBLK_DELAY,nullblk_timer);
+			return;
+		case 2:
+			end_request(nullblk_memory());
+			goto repeat;
+		default:
+			end_request(0);
+			goto repeat;
+	}
+}
+
+void nullblk_init(void)
+{
+	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	blk_dev[MAJOR_NR].max_sectors = NULLBLK_MAX_SECTORS;
+}
@@ -32,7 +32,9 @@ void do_rd_request(void)
 		end_request(0);
 		goto repeat;
 	}
-	if (CURRENT-> cmd == WRITE) {
+	if (addr == CURRENT->buffer)
+		;	/* a buffer of the ramdisk itself, see fs/buffer.c */
+	else if (CURRENT-> cmd == WRITE) {
 		(void ) memcpy(addr,
 			      CURRENT->buffer,
 			      len);
@@ -63,6 +65,141 @@ long rd_init(long mem_start, int length)
 	return(length);
 }
 
+/*
+ * A compressed image is an LZ4 frame (what "lz4 -9 image" makes) where
+ * the plain one would be, at block 256 of the floppy. It is inflated
+ * straight into the ramdisk as the floppy blocks come in, so matches
+ * are copied from what is already there and no window is needed.
+ */
+#define LZ4_MAGIC	0x184D2204
+
+static struct buffer_head * lz_bh;
+static int lz_block, lz_pos, lz_error;
+
+static int lz_byte(void)
+{
+	if (lz_error)
+		return 0;
+	if (lz_pos >= BLOCK_SIZE) {
+		brelse(lz_bh);
+		lz_block++;
+		if (!(lz_bh = breada(ROOT_DEV,lz_block,lz_block+1,lz_block+2,-1))) {
+			printk("I/O error on block %d, aborting load\n",lz_block);
+			lz_error = 1;
+			return 0;
+		}
+		lz_pos = 0;
+		printk("\010\010\010\010\010%4dk",lz_block-255);
+	}
+	return (unsigned char) lz_bh->b_data[lz_pos++];
+}
+
+static unsigned long lz_long(void)
+{
+	unsigned long n;
+
+	n = lz_byte();
+	n |= lz_byte() << 8;
+	n |= lz_byte() << 16;
+	return n | (lz_byte() << 24);
+}
+
+/* the length that follows a token nibble of 15 */
+static int lz_length(int len, int * left)
+{
+	int c;
+
+	do {
+		c = lz_byte();
+		(*left)--;
+		len += c;
+	} while (c == 255 && *left > 0 && !lz_error);
+	return len;
+}
+
+/*
+ * lz_block_data() inflates one compressed block of 'left' bytes to cp,
+ * and returns where it ended, or NULL if the data is bad.
+ */
+static char * lz_block_data(char * cp, int left)
+{
+	char * end = rd_start + rd_length;
+	int token, len, offset;
+
+	while (left > 0 && !lz_error) {
+		token = lz_byte();
+		left--;
+		if ((len = token >> 4) == 15)
+			len = lz_length(len,&left);
+		if (len > left || len > end - cp)
+			return NULL;
+		left -= len;
+		while (len--)
+			*cp++ = lz_byte();
+		if (left <= 0)
+			break;
+		offset = lz_byte();
+		offset |= lz_byte() << 8;
+		left -= 2;
+		if ((len = token & 15) == 15)
+			len = lz_length(len,&left);
+		len += 4;
+		if (!offset || offset > cp - rd_start || len > end - cp)
+			return NULL;
+		while (len--) {
+			*cp = cp[-offset];
+			cp++;
+		}
+	}
+	return lz_error ? NULL : cp;
+}
+
+/*
+ * rd_load_lz4() inflates the frame whose first block is bh into the
+ * ramdisk. Returns the number of bytes it got, or 0.
+ */
+static int rd_load_lz4(struct buffer_head * bh, int block)
+{
+	char * cp = rd_start;
+	int flags, size, i;
+
+	lz_bh = bh;
+	lz_block = block;
+	lz_pos = 4;
+	lz_error = 0;
+	flags = lz_byte();
+	lz_byte();
+	if ((flags >> 6) != 1) {
+		printk("Unknown LZ4 frame version\n");
+		brelse(lz_bh);
+		return 0;
+	}
+	i = 1 + ((flags & 8) ? 8 : 0) + ((flags & 1) ? 4 : 0);
+	while (i--)
+		lz_byte();
+	printk("Loading compressed ram disk... 0000k");
+	while (cp && (size = lz_long()) && !lz_error) {
+		if (size & 0x80000000) {
+			size &= 0x7fffffff;
+			if (size > rd_start + rd_length - cp)
+				cp = NULL;
+			else
+				while (size--)
+					*cp++ = lz_byte();
+		} else
+			cp = lz_block_data(cp,size);
+		if (flags & 0x10)
+			lz_long();
+	}
+	brelse(lz_bh);
+	if (!cp || lz_error) {
+		printk("\nBad compressed ram disk image\n");
+		return 0;
+	}
+	printk("\010\010\010\010\010done \n");
+	return cp - rd_start;
+}
+
 /*
  * If the root device is the ram disk, try to load it.
  * In order to do this, the root device is originally set to the
@@ -83,7 +220,24 @@ void rd_load(void)
 		(int) rd_start);
 	if (MAJOR(ROOT_DEV) != 2)
 		return;
-	bh = breada(ROOT_DEV,block+1,block,block+2,-1);
+	bh = breada(ROOT_DEV,block,block+1,block+2,-1);
+	if (!bh) {
+		printk("Disk error while looking for ramdisk!\n");
+		return;
+	}
+	if (*(unsigned long *) bh->b_data == LZ4_MAGIC) {
+		if (rd_load_lz4(bh,block) < 2*BLOCK_SIZE)
+			return;
+		s.s_magic = ((struct d_super_block *) (rd_start+BLOCK_SIZE))->s_magic;
+		if (s.s_magic != SUPER_MAGIC) {
+			printk("Compressed ram disk image isn't a minix fs\n");
+			return;
+		}
+		ROOT_DEV=0x0101;
+		return;
+	}
+	brelse(bh);
+	bh = bread(ROOT_DEV,block+1);
 	if (!bh) {
 		printk("Disk error while looking for ramdisk!\n");
 		return;
@@ -0,0 +1,318 @@
+/*
+ *  linux/kernel/blk_drv/virtio_blk.c
+ */
+
+/*
+ * virtio_blk.c drives the first virtio block device (legacy PCI
+ * interface, as QEMU's virtio-blk-pci has it), as minor 0 of major 8.
+ *
+ * A request is a chain of descriptors in the virtqueue: a header saying
+ * what to do, one descriptor per buffer, and a status byte the device
+ * writes. do_virtio_request() puts as many requests in the queue as
+ * there are descriptors for, and tells the device about them all with
+ * one write to the notify register - or none, if the device says it is
+ * busy with the queue anyway. The interrupt ends every request the
+ * device is done with, so one interrupt often ends many of them.
+ */
+
+#include <linux/config.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/pci.h>
+#include <asm/system.h>
+#include <asm/io.h>
+
+#define MAJOR_NR 8
+#include "blk.h"
+
+#define PCI_VENDOR_ID_VIRTIO	0x1af4
+#define PCI_DEVICE_ID_VIRTIO_BLK 0x1001
+
+/* legacy virtio registers, in the I/O space of BAR0 */
+#define VIRTIO_HOST_FEATURES	0x00
+#define VIRTIO_GUEST_FEATURES	0x04
+#define VIRTIO_QUEUE_PFN	0x08
+#define VIRTIO_QUEUE_SIZE	0x0c
+#define VIRTIO_QUEUE_SEL	0x0e
+#define VIRTIO_QUEUE_NOTIFY	0x10
+#define VIRTIO_STATUS		0x12
+#define VIRTIO_ISR		0x13
+#define VIRTIO_BLK_CAPACITY	0x14	/* 64 bits, in sectors */
+#define VIRTIO_BLK_SEG_MAX	0x20
+
+#define STATUS_ACKNOWLEDGE	1
+#define STATUS_DRIVER		2
+#define STATUS_DRIVER_OK	4
+#define STATUS_FAILED		128
+
+#define VIRTIO_BLK_F_SEG_MAX	(1UL<<2)
+
+#define VIRTIO_BLK_T_IN		0
+#define VIRTIO_BLK_T_OUT	1
+#define VIRTIO_BLK_S_OK		0
+
+#define VRING_DESC_F_NEXT	1
+#define VRING_DESC_F_WRITE	2
+#define VRING_USED_F_NO_NOTIFY	1
+
+/* the legacy interface has a fixed queue size: we take up to this */
+#define VQ_MAX		256
+#define VQ_MAX_SEGS	32	/* buffers per request */
+
+struct vring_desc {
+	unsigned long addr;
+	unsigned long addr_hi;
+	unsigned long len;
+	unsigned short flags;
+	unsigned short next;
+};
+
+struct vring_avail {
+	unsigned short flags;
+	unsigned short idx;
+	unsigned short ring[VQ_MAX];
+};
+
+struct vring_used {
+	unsigned short flags;
+	unsigned short idx;
+	struct {
+		unsigned long id;
+		unsigned long len;
+	} ring[VQ_MAX];
+};
+
+struct virtio_blk_outhdr {
+	unsigned long type;
+	unsigned long ioprio;
+	unsigned long sector;
+	unsigned long sector_hi;
+};
+
+/*
+ * The queue has to be physically contiguous and page aligned, which
+ * get_free_page() can't give us: it lives here. 4 pages are enough for
+ * 256 entries, plus one to align it.
+ */
+static unsigned char vq_memory[5*4096];
+
+static struct vring_desc * vq_desc;
+static struct vring_avail * vq_avail;
+static struct vring_used * vq_used;
+static int vq_num = 0;
+static int vq_free_head = 0;
+static int vq_nr_free = 0;
+static unsigned short vq_last_used = 0;
+
+/* what goes with a request, by the number of its first descriptor */
+static struct vblk_slot {
+	struct virtio_blk_outhdr hdr;
+	unsigned char status;
+	struct request * req;
+} vblk_slot[VQ_MAX];
+
+static unsigned int vblk_base = 0;
+static unsigned long vblk_sectors = 0;
+static int vblk_segs = VQ_MAX_SEGS;
+
+#define barrier() __asm__ __volatile__("":::"memory")
+
+static void virtio_end(struct request * req, int uptodate)
+{
+	struct buffer_head * bh;
+
+	if (!uptodate)
+		printk(DEVICE_NAME ": I/O error, dev %04x, sector %d\n\r",
+			req->dev,req->sector);
+	while ((bh = req->bh)) {
+		req->bh = bh->b_reqnext;
+		bh->b_reqnext = NULL;
+		bh->b_uptodate = uptodate;
+		unlock_buffer(bh);
+	}
+	wake_up(&req->waiting);
+	wake_up(&wait_for_request);
+	req->dev = -1;
+}
+
+static int get_desc(void)
+{
+	int i = vq_free_head;
+
+	vq_free_head = vq_desc[i].next;
+	vq_nr_free--;
+	return i;
+}
+
+static void put_desc_chain(int i)
+{
+	int n;
+
+	for (;;) {
+		n = vq_desc[i].next;
+		vq_desc[i].next = vq_free_head;
+		vq_free_head = i;
+		vq_nr_free++;
+		if (!(vq_desc[i].flags & VRING_DESC_F_NEXT))
+			break;
+		i = n;
+	}
+}
+
+static int add_desc(int prev, unsigned long addr, unsigned long len, int flags)
+{
+	int i = get_desc();
+
+	vq_desc[i].addr = addr;
+	vq_desc[i].addr_hi = 0;
+	vq_desc[i].len = len;
+	vq_desc[i].flags = flags;
+	if (prev >= 0) {
+		vq_desc[prev].next = i;
+		vq_desc[prev].flags |= VRING_DESC_F_NEXT;
+	}
+	return i;
+}
+
+/*
+ * queue_request() puts the descriptors of a request in the queue, and
+ * its first one in the available ring. The device isn't told yet.
+ */
+static void queue_request(struct request * req)
+{
+	struct buffer_head * bh;
+	struct vblk_slot * s;
+	int head, i, flags;
+
+	head = i = add_desc(-1,0,sizeof(struct virtio_blk_outhdr),0);
+	s = vblk_slot + head;
+	s->hdr.type = (req->cmd == WRITE) ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	s->hdr.ioprio = 0;
+	s->hdr.sector = req->sector;
+	s->hdr.sector_hi = 0;
+	s->status = 0xff;
+	s->req = req;
+	vq_desc[head].addr = (unsigned long) &s->hdr;
+	flags = (req->cmd == WRITE) ? 0 : VRING_DESC_F_WRITE;
+	if ((bh = req->bh))
+		for ( ; bh ; bh = bh->b_reqnext)
+			i = add_desc(i,(unsigned long) bh->b_data,BLOCK_SIZE,flags);
+	else
+		i = add_desc(i,(unsigned long) req->buffer,req->nr_sectors*512,flags);
+	add_desc(i,(unsigned long) &s->status,1,VRING_DESC_F_WRITE);
+	vq_avail->ring[vq_avail->idx % vq_num] = head;
+	barrier();
+	vq_avail->idx++;
+}
+
+static int nr_segs(struct request * req)
+{
+	struct buffer_head * bh;
+	int n = 0;
+
+	if (!req->bh)
+		return 1;
+	for (bh = req->bh ; bh ; bh = bh->b_reqnext)
+		n++;
+	return n;
+}
+
+static void do_virtio_request(void)
+{
+	struct request * req;
+	unsigned long flags;
+	int queued = 0;
+
+	save_flags(flags);
+	cli();
+	while ((req = CURRENT)) {
+		if (MAJOR(req->dev) != MAJOR_NR)
+			panic(DEVICE_NAME ": request list destroyed");
+		if (vq_nr_free < nr_segs(req) + 2)
+			break;
+		CURRENT = blk_next_request(blk_dev+MAJOR_NR);
+		if (DEVICE_NR(req->dev) != 0 ||
+		    req->sector + req->nr_sectors > vblk_sectors ||
+		    nr_segs(req) > vblk_segs) {
+			virtio_end(req,0);
+			continue;
+		}
+		queue_request(req);
+		queued++;
+	}
+	barrier();
+	if (queued && !(vq_used->flags & VRING_USED_F_NO_NOTIFY))
+		outw(0,vblk_base+VIRTIO_QUEUE_NOTIFY);
+	restore_flags(flags);
+}
+
+static void virtio_intr(void)
+{
+	struct vblk_slot * s;
+	int id;
+
+	if (!(inb(vblk_base+VIRTIO_ISR) & 1))
+		return;
+	while (vq_last_used != vq_used->idx) {
+		barrier();
+		id = vq_used->ring[vq_last_used % vq_num].id;
+		vq_last_used++;
+		s = vblk_slot + id;
+		put_desc_chain(id);
+		virtio_end(s->req,s->status == VIRTIO_BLK_S_OK);
+	}
+	do_virtio_request();
+}
+
+void virtio_blk_init(void)
+{
+	int bus, devfn, irq, i;
+	unsigned long base, mem;
+
+	if (!pci_find_device(PCI_VENDOR_ID_VIRTIO,PCI_DEVICE_ID_VIRTIO_BLK,0,
+	    &bus,&devfn))
+		return;
+	base = pci_read_config_dword(bus,devfn,PCI_BASE_ADDRESS_0);
+	if (!(base & PCI_BASE_ADDRESS_SPACE_IO))
+		return;
+	vblk_base = base & PCI_BASE_ADDRESS_IO_MASK;
+	irq = pci_read_config_byte(bus,devfn,PCI_INTERRUPT_LINE);
+	pci_write_config_word(bus,devfn,PCI_COMMAND,
+		pci_read_config_word(bus,devfn,PCI_COMMAND) |
+		PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+	outb(0,vblk_base+VIRTIO_STATUS);
+	outb(STATUS_ACKNOWLEDGE|STATUS_DRIVER,vblk_base+VIRTIO_STATUS);
+	if (inl(vblk_base+VIRTIO_HOST_FEATURES) & VIRTIO_BLK_F_SEG_MAX) {
+		outl(VIRTIO_BLK_F_SEG_MAX,vblk_base+VIRTIO_GUEST_FEATURES);
+		i = inl(vblk_base+VIRTIO_BLK_SEG_MAX);
+		if (i > 0 && i < vblk_segs)
+			vblk_segs = i;
+	} else
+		outl(0,vblk_base+VIRTIO_GUEST_FEATURES);
+	vblk_sectors = inl(vblk_base+VIRTIO_BLK_CAPACITY);
+	if (inl(vblk_base+VIRTIO_BLK_CAPACITY+4))
+		vblk_sectors = 0xffffffff;
+	outw(0,vblk_base+VIRTIO_QUEUE_SEL);
+	vq_num = inw(vblk_base+VIRTIO_QUEUE_SIZE);
+	if (!vq_num || vq_num > VQ_MAX || pci_request_irq(irq,virtio_intr)) {
+		printk(DEVICE_NAME ": can't use the device\n\r");
+		outb(STATUS_FAILED,vblk_base+VIRTIO_STATUS);
+		return;
+	}
+	mem = ((unsigned long) vq_memory + 4095) & ~4095UL;
+	vq_desc = (struct vring_desc *) mem;
+	vq_avail = (struct vring_avail *) (mem + vq_num*sizeof(struct vring_desc));
+	vq_used = (struct vring_used *) ((mem + vq_num*sizeof(struct vring_desc) +
+		(3+vq_num)*sizeof(unsigned short) + 4095) & ~4095UL);
+	for (i = 0 ; i < vq_num ; i++)
+		vq_desc[i].next = i+1;
+	vq_free_head = 0;
+	vq_nr_free = vq_num;
+	outl(mem >> 12,vblk_base+VIRTIO_QUEUE_PFN);
+	outb(STATUS_ACKNOWLEDGE|STATUS_DRIVER|STATUS_DRIVER_OK,
+		vblk_base+VIRTIO_STATUS);
+	blk_dev[MAJOR_NR].max_sectors = 2*vblk_segs;
+	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	printk(DEVICE_NAME ": %d sectors, queue of %d\n\r",vblk_sectors,vq_num);
+}
@@ -134,9 +134,14 @@ int do_exit(long code)
 		}
 
 	/* 关闭当前进程打开的所有文件 */
-	for (i=0 ; i<NR_OPEN ; i++)
+	for (i=0 ; i<current->max_fds ; i++)
 		if (current->filp[i])
 			sys_close(i);
+	if (current->filp != current->fd_array) {
+		free_page((long) current->filp);
+		current->filp = current->fd_array;
+		current->max_fds = NR_OPEN_DEFAULT;
+	}
 
 	/* 对当前进程工作目录 pwd、根目录 root 以及执行程序文件的 i 节点进行同步操作，放回各个 i 节点并分别置空（释放） */
 	iput(current->pwd);
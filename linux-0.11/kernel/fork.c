@@ -147,13 +147,27 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	p->tss.trace_bitmap = 0x80000000;
 	if (last_task_used_math == current)
 		__asm__("clts ; fnsave %0"::"m" (p->tss.i387));
+	/* 文件描述符表超出 fd_array 时是单独的一页，子进程要有自己的一份 */
+	if (current->filp == current->fd_array)
+		p->filp = p->fd_array;
+	else {
+		if (!(p->filp = (struct file **) get_free_page())) {
+			task[nr] = NULL;
+			free_page((long) p);
+			return -EAGAIN;
+		}
+		for (i=0; i<p->max_fds; i++)
+			p->filp[i] = current->filp[i];
+	}
 	/* 为新建进程开辟新的页表，把当前进程的页表项复制过去。这时新进程和当前进程指向相同的物理页。 */
 	if (copy_mem(nr,p)) {
+		if (p->filp != p->fd_array)
+			free_page((long) p->filp);
 		task[nr] = NULL;
 		free_page((long) p);
 		return -EAGAIN;
 	}
-	for (i=0; i<NR_OPEN;i++)
+	for (i=0; i<p->max_fds;i++)
 		if ((f=p->filp[i]))
 			f->f_count++;
 	if (current->pwd)
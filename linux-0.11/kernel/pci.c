@@ -0,0 +1,167 @@
+/*
+ *  linux/kernel/pci.c
+ */
+
+/*
+ * Just enough PCI for the drivers to find their controllers: reading and
+ * writing configuration space with configuration mechanism #1, and
+ * finding devices by id or by class. Nothing is remapped or assigned,
+ * we use what the BIOS set up.
+ */
+
+#include <linux/head.h>
+#include <linux/pci.h>
+#include <asm/system.h>
+#include <asm/io.h>
+
+/* emulators and small machines have everything on the first few buses */
+#define PCI_MAX_BUS		8
+
+#define PCI_CONFIG_ADDRESS	0xcf8
+#define PCI_CONFIG_DATA		0xcfc
+
+#define PCI_ADDR(bus,devfn,where) \
+(0x80000000UL | ((bus)<<16) | ((devfn)<<8) | ((where) & 0xfc))
+
+/* handlers per irq: PCI devices can share a line */
+#define NR_IRQ_SHARE	4
+
+extern void pci_irq5(void), pci_irq9(void), pci_irq10(void), pci_irq11(void);
+
+static void (*irq_handler[16][NR_IRQ_SHARE])(void);
+
+/*
+ * pci_present() checks that there is a mechanism #1 host bridge: the
+ * address register reads back what was written to it.
+ */
+int pci_present(void)
+{
+	unsigned long old;
+	int ok;
+
+	old = inl(PCI_CONFIG_ADDRESS);
+	outl(0x80000000UL,PCI_CONFIG_ADDRESS);
+	ok = (inl(PCI_CONFIG_ADDRESS) == 0x80000000UL);
+	outl(old,PCI_CONFIG_ADDRESS);
+	return ok;
+}
+
+unsigned long pci_read_config_dword(int bus, int devfn, int where)
+{
+	outl(PCI_ADDR(bus,devfn,where),PCI_CONFIG_ADDRESS);
+	return inl(PCI_CONFIG_DATA);
+}
+
+unsigned short pci_read_config_word(int bus, int devfn, int where)
+{
+	return pci_read_config_dword(bus,devfn,where) >> ((where & 2) * 8);
+}
+
+unsigned char pci_read_config_byte(int bus, int devfn, int where)
+{
+	return pci_read_config_dword(bus,devfn,where) >> ((where & 3) * 8);
+}
+
+void pci_write_config_dword(int bus, int devfn, int where, unsigned long val)
+{
+	outl(PCI_ADDR(bus,devfn,where),PCI_CONFIG_ADDRESS);
+	outl(val,PCI_CONFIG_DATA);
+}
+
+void pci_write_config_word(int bus, int devfn, int where, unsigned short val)
+{
+	outl(PCI_ADDR(bus,devfn,where),PCI_CONFIG_ADDRESS);
+	outw(val,PCI_CONFIG_DATA + (where & 2));
+}
+
+/*
+ * pci_scan() calls match() for every function on the buses, and returns
+ * the index'th one it likes (counting from 0) in *bus and *devfn.
+ * Returns 0 if there's no such device.
+ */
+static int pci_scan(int (*match)(int bus, int devfn, int a, int b),
+	int a, int b, int index, int * bus, int * devfn)
+{
+	int i, j;
+
+	if (!pci_present())
+		return 0;
+	for (i = 0 ; i < PCI_MAX_BUS ; i++)
+		for (j = 0 ; j < 256 ; j++) {
+			if ((j & 7) && !(pci_read_config_byte(i,j & ~7,
+			    PCI_HEADER_TYPE) & 0x80))
+				continue;
+			if (pci_read_config_word(i,j,PCI_VENDOR_ID) == 0xffff)
+				continue;
+			if (!match(i,j,a,b) || index-- > 0)
+				continue;
+			*bus = i;
+			*devfn = j;
+			return 1;
+		}
+	return 0;
+}
+
+static int match_device(int bus, int devfn, int vendor, int device)
+{
+	return pci_read_config_word(bus,devfn,PCI_VENDOR_ID) == vendor &&
+		pci_read_config_word(bus,devfn,PCI_DEVICE_ID) == device;
+}
+
+static int match_class(int bus, int devfn, int class, int unused)
+{
+	return pci_read_config_word(bus,devfn,PCI_CLASS_DEVICE) == class;
+}
+
+int pci_find_device(int vendor, int device, int index, int * bus, int * devfn)
+{
+	return pci_scan(match_device,vendor,device,index,bus,devfn);
+}
+
+int pci_find_class(int class, int index, int * bus, int * devfn)
+{
+	return pci_scan(match_class,class,0,index,bus,devfn);
+}
+
+/*
+ * pci_request_irq() has handler called when interrupt 'irq' arrives.
+ * Only the lines that the BIOS normally gives to PCI devices, and that
+ * no other driver uses, are handled. Returns 0 if ok, -1 if not.
+ */
+int pci_request_irq(int irq, void (*handler)(void))
+{
+	void (*entry)(void);
+	int i;
+
+	switch (irq) {
+		case 5: entry = pci_irq5; break;
+		case 9: entry = pci_irq9; break;
+		case 10: entry = pci_irq10; break;
+		case 11: entry = pci_irq11; break;
+		default: return -1;
+	}
+	for (i = 0 ; i < NR_IRQ_SHARE ; i++)
+		if (!irq_handler[irq][i])
+			break;
+	if (i >= NR_IRQ_SHARE)
+		return -1;
+	irq_handler[irq][i] = handler;
+	if (i)
+		return 0;
+	set_intr_gate(0x20+irq,entry);
+	if (irq < 8)
+		outb_p(inb_p(0x21)&~(1<<irq),0x21);
+	else {
+		outb_p(inb_p(0x21)&0xfb,0x21);
+		outb(inb_p(0xA1)&~(1<<(irq-8)),0xA1);
+	}
+	return 0;
+}
+
+void do_pci_irq(int irq)
+{
+	int i;
+
+	for (i = 0 ; i < NR_IRQ_SHARE && irq_handler[irq][i] ; i++)
+		(irq_handler[irq][i])();
+}
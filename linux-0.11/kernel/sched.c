@@ -34,6 +34,8 @@ void show_task(int nr,struct task_struct * p)
 	printk("%d (of %d) chars free in kernel stack\n\r",i,j);
 }
 
+extern void show_hd_stat(void);
+
 void show_stat(void)
 {
 	int i;
@@ -41,6 +43,8 @@ void show_stat(void)
 	for (i=0;i<NR_TASKS;i++)
 		if (task[i])
 			show_task(i,task[i]);
+	show_buffers();
+	show_hd_stat();
 }
 
 #define LATCH (1193180/HZ)
@@ -619,8 +623,11 @@ struct task_struct {
 	struct m_inode * pwd;                                                NULL
 	struct m_inode * root;                                               NULL
 	struct m_inode * executable;                                         NULL
-	unsigned long close_on_exec;                                         0
-	struct file * filp[NR_OPEN];                                         {NULL, }
+	unsigned long close_on_exec[FD_WORDS];                               {0, }
+	unsigned long open_fds[FD_WORDS];                                    {0, }
+	int max_fds;                                                         NR_OPEN_DEFAULT
+	struct file ** filp;                                                 init_task.task.fd_array
+	struct file * fd_array[NR_OPEN_DEFAULT];                             {NULL, }
 /* ldt for this task 0 - zero 1 - cs 2 - ds&ss 
 	struct desc_struct ldt[3];                                           {0x00000000 00000000, 0x00c0fa00 0000009f, 0x00c0f200 0000009f} 640KB, base = 0
 /* tss for this task 
@@ -58,7 +58,7 @@ sa_mask = 4
 sa_flags = 8
 sa_restorer = 12
 
-nr_system_calls = 72
+nr_system_calls = 75
 
 /*
  * Ok, I get parallel printer interrupts while using the floppy for some
@@ -66,6 +66,7 @@ nr_system_calls = 72
  */
 .globl system_call,sys_fork,timer_interrupt,sys_execve
 .globl hd_interrupt,floppy_interrupt,parallel_interrupt
+.globl pci_irq5,pci_irq9,pci_irq10,pci_irq11
 .globl device_not_available, coprocessor_error
 
 .align 2
@@ -361,6 +362,46 @@ hd_interrupt:
 	popl %eax
 	iret
 
+/*
+ * Interrupts of PCI devices, see pci_request_irq(). The lines are level
+ * triggered, so the EOI goes out after the handlers have quietened the
+ * devices down.
+ */
+.macro pci_irq nr
+pci_irq\nr:
+	pushl %eax
+	pushl %ecx
+	pushl %edx
+	push %ds
+	push %es
+	push %fs
+	movl $0x10,%eax
+	mov %ax,%ds
+	mov %ax,%es
+	movl $0x17,%eax
+	mov %ax,%fs
+	pushl $\nr
+	call do_pci_irq
+	addl $4,%esp
+	movb $0x20,%al
+.if \nr >= 8
+	outb %al,$0xA0		# EOI to interrupt controller #2
+.endif
+	outb %al,$0x20		# EOI to interrupt controller #1
+	pop %fs
+	pop %es
+	pop %ds
+	popl %edx
+	popl %ecx
+	popl %eax
+	iret
+.endm
+
+pci_irq 5
+pci_irq 9
+pci_irq 10
+pci_irq 11
+
 floppy_interrupt:
 	pushl %eax
 	pushl %ecx
@@ -27,6 +27,7 @@
 #include <linux/sched.h>
 #include <linux/head.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
 
 volatile void do_exit(long code);
 
@@ -55,6 +56,7 @@ static long HIGH_MEMORY = 0;
 __asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024))
 
 static unsigned char mem_map [ PAGING_PAGES ] = {0,};
+int nr_free_pages = 0;		/* entries of mem_map that are 0 */
 
 /*
  * Get physical address of first (actually last :-) free page, and mark it
@@ -65,7 +67,7 @@ static unsigned char mem_map [ PAGING_PAGES ] = {0,};
  * scasb: SCAN String Byte, 就是计算 cmp al, byte ptr [es:edi],如果DF=0，完成后edi自增1.
  * repne: 表示把后面的指令最多执行 ecx 次，直到 ZF=1 为止就不再执行
  */
-unsigned long get_free_page(void)
+static unsigned long __get_free_page(void)
 {
 register unsigned long __res asm("ax");
 
@@ -87,6 +89,59 @@ __asm__("std ; repne ; scasb\n\t"    /* 找到一个不为0的字节 */
 return __res;
 }
 
+/*
+ * get_free_page() only fails once the page cache and the buffer cache
+ * have nothing left that they can give back.
+ */
+unsigned long get_free_page(void)
+{
+	unsigned long page;
+
+	while (!(page = __get_free_page()))
+		if (!shrink_page_cache() && !shrink_buffers())
+			return 0;
+	nr_free_pages--;
+	return page;
+}
+
+/*
+ * ioremap() makes the page of device memory at 'phys' addressable by the
+ * kernel, which only sees the low 16MB: it takes a free page there and
+ * points its page table entry at the device, uncached. The RAM behind
+ * it is lost, which is ok for the few pages drivers need. Returns the
+ * address to use (with the offset in the page of 'phys'), or 0.
+ */
+unsigned long ioremap(unsigned long phys)
+{
+	unsigned long page, * table;
+
+	if (!(page = get_free_page()))
+		return 0;
+	table = (unsigned long *) (0xfffff000 & pg_dir[page>>22]);
+	table[(page>>12) & 0x3ff] = (phys & 0xfffff000) | 0x1b; /* PCD,PWT,RW,P */
+	invalidate();
+	return page + (phys & 0xfff);
+}
+
+/*
+ * page_ref() adds a reference to a page that is already in use, and
+ * page_count() returns the number of references. They are used by the
+ * page cache, which shares its pages with the tasks mapping them.
+ */
+void page_ref(unsigned long addr)
+{
+	if (addr < LOW_MEM || addr >= HIGH_MEMORY)
+		panic("page_ref: bad page");
+	mem_map[MAP_NR(addr)]++;
+}
+
+int page_count(unsigned long addr)
+{
+	if (addr < LOW_MEM || addr >= HIGH_MEMORY)
+		return 0;
+	return mem_map[MAP_NR(addr)];
+}
+
 /*
  * Free a page of memory at physical address 'addr'. Used by
  * 'free_page_tables()'
@@ -98,7 +153,11 @@ void free_page(unsigned long addr)
 		panic("trying to free nonexistent page");
 	addr -= LOW_MEM;
 	addr >>= 12;
-	if (mem_map[addr]--) return;
+	if (mem_map[addr]--) {
+		if (!mem_map[addr])
+			nr_free_pages++;
+		return;
+	}
 	mem_map[addr]=0;
 	panic("trying to free free page");
 }
@@ -246,6 +305,28 @@ unsigned long put_page(unsigned long page,unsigned long address)
 	return page;
 }
 
+/*
+ * put_shared_page() is put_page() for a page that others use as well (a
+ * page cache page): it is mapped read-only, so the first write to it
+ * makes a private copy in un_wp_page().
+ */
+static unsigned long put_shared_page(unsigned long page,unsigned long address)
+{
+	unsigned long tmp, *page_table;
+
+	page_table = (unsigned long *) ((address>>20) & 0xffc);
+	if ((*page_table)&1)
+		page_table = (unsigned long *) (0xfffff000 & *page_table);
+	else {
+		if (!(tmp=get_free_page()))
+			return 0;
+		*page_table = tmp|7;
+		page_table = (unsigned long *) tmp;
+	}
+	page_table[(address>>12) & 0x3ff] = page | 5;
+	return page;
+}
+
 void un_wp_page(unsigned long * table_entry)
 {
 	unsigned long old_page,new_page;
@@ -433,9 +514,21 @@ void do_no_page(unsigned long error_code,unsigned long address)
 	}
 	if (share_page(tmp)) /* 如果不能共享，继续 */
 		return;
+/* remember that 1 block is used for header */
+	block = 1 + tmp/BLOCK_SIZE; /* 计算起始块号 */
+	/*
+		整页都在 end_data 之内时，直接映射页面高速缓冲中的页（只读，写时复制），
+		不需要读盘也不需要复制。最后那个不完整的页还要清零，仍按老办法处理。
+	 */
+	if (tmp + PAGE_SIZE <= current->end_data &&
+	    (page = get_cache_page(current->executable,block))) {
+		if (put_shared_page(page,address))
+			return;
+		free_page(page);
+		oom();
+	}
 	if (!(page = get_free_page())) /* 申请一个物理页 */
 		oom();
-/* remember that 1 block is used for header */
 /* 
 	程序头需要使用一个数据块。在读文件时，需要跳过第一块数据。
 	先计算缺页所在的数据块号。因为每块数据长度为 BLOCK_SIZE = 1KB,因此一页内存可以存放 4 个数据块。
@@ -443,7 +536,6 @@ void do_no_page(unsigned long error_code,unsigned long address)
 	块号和执行文件的 i 节点，我们就可以从映射位图中找到对应块设备中的对应的设备块号（保存在nr[]数组中）。
 	利用 bread_page() 即可把这 4 个逻辑块读入到物理页面 page 中。
  */
-	block = 1 + tmp/BLOCK_SIZE; /* 计算起始块号 */
 	for (i=0 ; i<4 ; block++,i++)
 		nr[i] = bmap(current->executable,block);  /* 设备上对应的逻辑块号 */
 	bread_page(page,current->executable->i_dev,nr); /* 读设备上 4 个逻辑块放到刚申请的 page 中 */
@@ -492,8 +584,10 @@ void mem_init(long start_mem, long end_mem)
 	i = MAP_NR(start_mem);
 	end_mem -= start_mem;
 	end_mem >>= 12;
-	while (end_mem-->0)
+	while (end_mem-->0) {
 		mem_map[i++]=0;
+		nr_free_pages++;
+	}
 }
 
 void calc_mem(void)